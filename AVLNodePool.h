@@ -0,0 +1,238 @@
+#ifndef AVLNODEPOOL_H
+#define AVLNODEPOOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+// How an AVLNodePool treats individually released nodes.
+//  Slab:  released nodes go onto a free list and are handed out again before
+//         any fresh slab space; reset() keeps the slabs for the next fill.
+//  Arena: released nodes are only reclaimed in bulk; reset() gives every slab
+//         back to the allocator.
+enum class NodePoolMode
+{
+    Slab,
+    Arena
+};
+
+struct NodePoolStats
+{
+    std::size_t slabs;     // slabs currently held
+    std::size_t capacity;  // nodes the held slabs can store
+    std::size_t liveNodes; // nodes handed out and not yet released
+    std::size_t freeNodes; // length of the free list
+};
+
+// Slab allocator for fixed-size tree nodes. Storage comes from NodeAlloc in
+// slabs that double in size up to maxSlabNodes; the pool hands out raw,
+// unconstructed Node storage and never runs node destructors itself.
+template <typename Node, typename NodeAlloc>
+class AVLNodePool
+{
+public:
+    typedef std::allocator_traits<NodeAlloc> AllocTraits;
+
+    static const std::size_t minSlabNodes = 32;
+    static const std::size_t maxSlabNodes = 65536;
+
+    explicit AVLNodePool(const NodeAlloc &alloc = NodeAlloc(), NodePoolMode mode = NodePoolMode::Slab)
+        : alloc(alloc), mode(mode)
+    {
+    }
+
+    AVLNodePool(const AVLNodePool &) = delete;
+    AVLNodePool &operator=(const AVLNodePool &) = delete;
+
+    ~AVLNodePool()
+    {
+        release();
+    }
+
+    Node *allocate()
+    {
+        Node *node;
+        if (freeList != nullptr)
+        {
+            node = reinterpret_cast<Node *>(freeList);
+            freeList = freeList->next;
+            freeCount--;
+        }
+        else
+        {
+            if (current == slabs.size() || slabs[current].used == slabs[current].count)
+            {
+                nextSlab();
+            }
+            Slab &slab = slabs[current];
+            node = slab.base + slab.used++;
+        }
+        liveCount++;
+        return node;
+    }
+
+    // Storage for count nodes laid out back to back, carved from a slab of
+    // its own so that the nodes are contiguous in memory.
+    Node *allocateBlock(std::size_t count)
+    {
+        Slab slab;
+        slab.base = AllocTraits::allocate(alloc, count);
+        slab.count = count;
+        slab.used = count;
+        slabs.push_back(slab);
+        liveCount += count;
+        return slab.base;
+    }
+
+    void deallocate(Node *node)
+    {
+        liveCount--;
+        if (mode == NodePoolMode::Slab)
+        {
+            freeList = ::new (static_cast<void *>(node)) FreeNode(freeList);
+            freeCount++;
+        }
+    }
+
+    // Take over every slab and free node of other, leaving it empty, so that
+    // nodes can move between trees. The two allocators must compare equal.
+    void adopt(AVLNodePool &other)
+    {
+        assert(alloc == other.alloc);
+        slabs.insert(slabs.end(), other.slabs.begin(), other.slabs.end());
+        if (other.freeList != nullptr)
+        {
+            FreeNode *tail = other.freeList;
+            while (tail->next != nullptr)
+            {
+                tail = tail->next;
+            }
+            tail->next = freeList;
+            freeList = other.freeList;
+        }
+        freeCount += other.freeCount;
+        liveCount += other.liveCount;
+
+        other.slabs.clear();
+        other.current = 0;
+        other.freeList = nullptr;
+        other.freeCount = 0;
+        other.liveCount = 0;
+    }
+
+    // Forget every node handed out, in O(#slabs). Callers must already have
+    // run any non-trivial node destructors.
+    void reset()
+    {
+        if (mode == NodePoolMode::Arena)
+        {
+            release();
+            return;
+        }
+        for (std::size_t i = 0; i < slabs.size(); i++)
+        {
+            slabs[i].used = 0;
+        }
+        current = 0;
+        freeList = nullptr;
+        freeCount = 0;
+        liveCount = 0;
+    }
+
+    // Return every slab to the allocator.
+    void release()
+    {
+        for (std::size_t i = 0; i < slabs.size(); i++)
+        {
+            AllocTraits::deallocate(alloc, slabs[i].base, slabs[i].count);
+        }
+        slabs.clear();
+        current = 0;
+        freeList = nullptr;
+        freeCount = 0;
+        liveCount = 0;
+    }
+
+    NodePoolMode getMode() const
+    {
+        return mode;
+    }
+
+    void setMode(NodePoolMode newMode)
+    {
+        mode = newMode;
+    }
+
+    NodePoolStats stats() const
+    {
+        NodePoolStats result;
+        result.slabs = slabs.size();
+        result.capacity = 0;
+        for (std::size_t i = 0; i < slabs.size(); i++)
+        {
+            result.capacity += slabs[i].count;
+        }
+        result.liveNodes = liveCount;
+        result.freeNodes = freeCount;
+        return result;
+    }
+
+    NodeAlloc &allocator()
+    {
+        return alloc;
+    }
+
+private:
+    struct Slab
+    {
+        Node *base;
+        std::size_t count;
+        std::size_t used;
+    };
+
+    // Overlays the storage of a released node.
+    struct FreeNode
+    {
+        FreeNode *next;
+        explicit FreeNode(FreeNode *next) : next(next) {}
+    };
+    static_assert(sizeof(Node) >= sizeof(FreeNode), "node too small to hold a free-list link");
+
+    // Advance to the next slab that has room, allocating one if none is left.
+    void nextSlab()
+    {
+        while (current < slabs.size() && slabs[current].used == slabs[current].count)
+        {
+            current++;
+        }
+        if (current < slabs.size())
+        {
+            return;
+        }
+        std::size_t count = slabs.empty() ? minSlabNodes : std::min(slabs.back().count * 2, maxSlabNodes);
+        Slab slab;
+        slab.base = AllocTraits::allocate(alloc, count);
+        slab.count = count;
+        slab.used = 0;
+        slabs.push_back(slab);
+    }
+
+    NodeAlloc alloc;
+    NodePoolMode mode;
+    std::vector<Slab> slabs;
+    std::size_t current = 0;
+    FreeNode *freeList = nullptr;
+    std::size_t freeCount = 0;
+    std::size_t liveCount = 0;
+};
+
+template <typename Node, typename NodeAlloc>
+const std::size_t AVLNodePool<Node, NodeAlloc>::minSlabNodes;
+
+template <typename Node, typename NodeAlloc>
+const std::size_t AVLNodePool<Node, NodeAlloc>::maxSlabNodes;
+
+#endif // AVLNODEPOOL_H
@@ -1,72 +1,2715 @@
-#ifndef AVLTREE_H
-#define AVLTREE_H
-
-#include <iostream>
-#include <algorithm>
-#include <queue>
-#include <stack>
-#include <string>
-
-class AVLTree
-{
-public: // For testing purposes
-    struct Node
-    {
-        int data;
-        Node *left;
-        Node *right;
-        int height;
-    };
-    std::size_t size = 0;
-
-    Node *root = nullptr;
-
-    int height(Node *node);
-    int getBalanceFactor(Node *node);
-    Node *rightRotate(Node *y);
-    Node *leftRotate(Node *x);
-    Node *insert(Node *node, int data);
-    Node *deleteNode(Node *root, int key);
-    void inorderTraversal(Node *root);
-    void preorderTraversal(Node *root);
-    void postorderTraversal(Node *root);
-    void levelOrderTraversal(Node *root);
-    bool depthFirstSearch(Node *root, int key);
-    bool breadthFirstSearch(Node *root, int key);
-    Node *findMin(Node *root);
-    Node *findMax(Node *root);
-    void clear(Node *root);
-    int countNodes(Node *root);
-    bool isBalanced(Node *root);
-    Node *findSuccessor(Node *root, int key);
-    Node *findPredecessor(Node *root, int key);
-    void rangeSearch(Node *root, int k1, int k2);
-    Node *updateKey(Node *root, int oldKey, int newKey);
-
-public:
-    std::vector<int> *result = new std::vector<int>();
-    AVLTree();
-    ~AVLTree();
-    void insert(int data);
-    void remove(int data);
-    int getRoot();
-    std::size_t getsize();
-    void inorderTraversal();
-    void preorderTraversal();
-    void postorderTraversal();
-    void levelOrderTraversal();
-    bool depthFirstSearch(int key);
-    bool breadthFirstSearch(int key);
-    int height();
-    int minimum();
-    int maximum();
-    void clear();
-    int count();
-    bool isBalanced();
-    int successor(int key);
-    int predecessor(int key);
-    void rangeSearch(int k1, int k2);
-    void updateKey(int oldKey, int newKey);
-};
-
-#endif // AVLTREE_H
+#ifndef AVLTREE_H
+#define AVLTREE_H
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "AVLNodePool.h"
+#include "Crc32c.h"
+#include "WorkStealingPool.h"
+
+namespace avl_detail
+{
+    // Value returned by minimum()/maximum()/successor()/predecessor() when there is no answer:
+    // -1 for arithmetic keys (the historical int behaviour), a default-constructed key otherwise.
+    template <typename Key>
+    Key missingKey(std::true_type)
+    {
+        return static_cast<Key>(-1);
+    }
+
+    template <typename Key>
+    Key missingKey(std::false_type)
+    {
+        return Key();
+    }
+
+    // Traversal visitors may return void (visit everything) or something
+    // convertible to bool (false stops the walk).
+    template <typename Visitor, typename Key>
+    bool keepVisiting(Visitor &visit, const Key &key, std::true_type)
+    {
+        visit(key);
+        return true;
+    }
+
+    template <typename Visitor, typename Key>
+    bool keepVisiting(Visitor &visit, const Key &key, std::false_type)
+    {
+        return static_cast<bool>(visit(key));
+    }
+
+    template <typename Visitor, typename Key>
+    bool keepVisiting(Visitor &visit, const Key &key)
+    {
+        return keepVisiting(visit, key, typename std::is_void<decltype(visit(key))>::type());
+    }
+
+    // LEB128 varints and little-endian fixed-width fields for snapshots.
+    inline void putVarint(std::string &out, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline bool getVarint(const unsigned char *&next, const unsigned char *end, std::uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && next != end; shift += 7)
+        {
+            unsigned char byte = *next++;
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (byte < 0x80)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void putFixed(std::string &out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+        {
+            out.push_back(static_cast<char>(value >> (8 * i)));
+        }
+    }
+
+    inline std::uint64_t getFixed(const unsigned char *data, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+        {
+            value |= static_cast<std::uint64_t>(data[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    inline void prefetch(const void *address)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+}
+
+template <typename Key, typename Compare>
+class BasicFrozenSet;
+
+// Header-only AVL tree. Compare is a strict weak ordering taken by value so that
+// comparisons are inlined into every descent; Alloc is rebound to allocate the
+// slabs of the node pool.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = std::allocator<Key>>
+class BasicAVLTree
+{
+public: // For testing purposes
+    struct Node
+    {
+        Key data;
+        Node *left;
+        Node *right;
+        int height;
+        std::uint32_t subtreeSize; // nodes in this subtree; shares height's padding word
+
+        explicit Node(const Key &data) : data(data), left(nullptr), right(nullptr), height(1), subtreeSize(1) {}
+    };
+    typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeAllocTraits;
+
+    // AVL height is below 1.45 log2(n + 2), so no tree that fits in a 64-bit
+    // address space is taller than this; bounds the explicit path stacks.
+    static const int maxHeight = 96;
+
+    std::size_t size = 0;
+
+    Node *root = nullptr;
+    Compare comp;
+    AVLNodePool<Node, NodeAllocator> pool;
+    std::vector<Node *> levelBuffer; // ring buffer reused by the breadth-first walks
+    std::size_t relayoutInterval = 0; // 0: nodes are never relaid automatically
+    std::size_t mutationsSinceLayout = 0;
+
+    Node *createNode(const Key &data);
+    void destroyNode(Node *node);
+    static Key notFound();
+
+    static int height(Node *node);
+    static std::size_t sizeOf(Node *node);
+    void updateNode(Node *node);
+    int getBalanceFactor(Node *node);
+    Node *rightRotate(Node *y);
+    Node *leftRotate(Node *x);
+    Node *rebalance(Node *node);
+    void retrace(Node **path[], int depth, int sizeDelta);
+    int insertionPath(Node **&link, Node **path[], const Key &key);
+    Node *insert(Node *node, const Key &data);
+    bool attachNode(Node *&root, Node *node);
+    Node *detachNode(Node *&root, const Key &key);
+    Node *deleteNode(Node *root, const Key &key);
+    void inorderTraversal(Node *root);
+    void preorderTraversal(Node *root);
+    void postorderTraversal(Node *root);
+    void levelOrderTraversal(Node *root);
+    std::size_t reserveLevelBuffer(Node *root);
+    bool depthFirstSearch(Node *root, const Key &key);
+    bool breadthFirstSearch(Node *root, const Key &key);
+    Node *findMin(Node *root);
+    Node *findMax(Node *root);
+    void clear(Node *root);
+    int countNodes(Node *root);
+    bool isBalanced(Node *root);
+    Node *findSuccessor(Node *root, const Key &key);
+    Node *findPredecessor(Node *root, const Key &key);
+    void rangeSearch(Node *root, const Key &k1, const Key &k2);
+    Node *updateKey(Node *root, const Key &oldKey, const Key &newKey);
+    Node *lowerBound(Node *root, const Key &key) const;
+    Node *upperBound(Node *root, const Key &key) const;
+    Node *find(Node *root, const Key &key) const;
+    std::size_t rank(Node *root, const Key &key) const;
+    Node *selectNode(Node *root, std::size_t index) const;
+    template <typename Visitor>
+    bool visitInorder(Node *root, Visitor &visit) const;
+    template <typename Visitor>
+    bool visitPreorder(Node *root, Visitor &visit) const;
+    template <typename Visitor>
+    bool visitPostorder(Node *root, Visitor &visit) const;
+    template <typename Visitor>
+    bool visitLevel(Node *root, int level, Visitor &visit) const;
+    template <typename Visitor>
+    bool visitRange(Node *root, const Key &k1, const Key &k2, Visitor &visit) const;
+    template <typename ForwardIt>
+    Node *buildBalanced(ForwardIt &next, ForwardIt last, Node *&block, std::size_t count, int &height);
+    void vebOrder(Node *root, int levels, std::vector<Node *> &order);
+    void vebBottoms(Node *node, int depth, int levels, std::vector<Node *> &order);
+    void noteMutations(std::size_t count);
+
+    // Nodes dropped by a set operation, chained through their left links and
+    // freed once the operation is over, so that parallel branches never touch the pool.
+    struct DroppedNodes
+    {
+        Node *head = nullptr;
+        Node *tail = nullptr;
+        std::size_t count = 0;
+
+        void push(Node *node)
+        {
+            node->left = head;
+            head = node;
+            if (tail == nullptr)
+            {
+                tail = node;
+            }
+            count++;
+        }
+
+        void pushTree(Node *root)
+        {
+            if (root != nullptr)
+            {
+                Node *right = root->right;
+                pushTree(root->left);
+                pushTree(right);
+                push(root);
+            }
+        }
+
+        void append(DroppedNodes &other)
+        {
+            if (other.head == nullptr)
+            {
+                return;
+            }
+            other.tail->left = head;
+            head = other.head;
+            if (tail == nullptr)
+            {
+                tail = other.tail;
+            }
+            count += other.count;
+        }
+    };
+    typedef Node *(BasicAVLTree::*SetOperation)(Node *, Node *, DroppedNodes &, WorkStealingPool *, std::size_t);
+
+    Node *joinRight(Node *left, Node *middle, Node *right);
+    Node *joinLeft(Node *left, Node *middle, Node *right);
+    Node *join(Node *left, Node *middle, Node *right);
+    Node *splitLast(Node *root, Node *&last);
+    Node *concat(Node *left, Node *right);
+    void split(Node *root, const Key &key, Node *&left, Node *&match, Node *&right);
+    bool worthForking(Node *a, Node *b, WorkStealingPool *workers, std::size_t grainSize);
+    Node *unionOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize);
+    Node *intersectionOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize);
+    Node *differenceOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize);
+    void combineWith(BasicAVLTree &other, SetOperation operation, WorkStealingPool *workers, std::size_t grainSize);
+    Node *insertSorted(Node *root, const Key *first, const Key *last, std::size_t &added);
+    Node *eraseSorted(Node *root, const Key *first, const Key *last, DroppedNodes &dropped);
+    void prefetchBatchPaths(const Key *first, const Key *last) const;
+    static const std::size_t batchWindow = 256;
+    template <typename InputIt>
+    static std::vector<Key> sortedBatch(InputIt first, InputIt last, const Compare &comp);
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+    typedef Alloc allocator_type;
+
+    // In-order bidirectional iterator. It carries the path from the root down
+    // to its node, so ++ and -- are amortized O(1) without parent pointers;
+    // copies only move the live part of the path. Like any set iterator it
+    // is read-only, and any insert or remove invalidates it.
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Key value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Key *pointer;
+        typedef const Key &reference;
+
+        const_iterator() : tree(nullptr), node(nullptr), depth(0) {}
+
+        const_iterator(const const_iterator &other) : tree(other.tree), node(other.node), depth(other.depth)
+        {
+            copyPath(other);
+        }
+
+        const_iterator &operator=(const const_iterator &other)
+        {
+            tree = other.tree;
+            node = other.node;
+            depth = other.depth;
+            copyPath(other);
+            return *this;
+        }
+
+        reference operator*() const
+        {
+            return node->data;
+        }
+
+        pointer operator->() const
+        {
+            return &node->data;
+        }
+
+        const_iterator &operator++()
+        {
+            if (node->right != nullptr)
+            {
+                path[depth++] = node;
+                descendLeft(node->right);
+                return *this;
+            }
+            // Climb until we arrive from a left child; past the root is end()
+            while (depth > 0 && path[depth - 1]->right == node)
+            {
+                node = path[--depth];
+            }
+            node = (depth > 0) ? path[--depth] : nullptr;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator before(*this);
+            ++*this;
+            return before;
+        }
+
+        const_iterator &operator--()
+        {
+            if (node == nullptr)
+            {
+                descendRight(tree->root);
+                return *this;
+            }
+            if (node->left != nullptr)
+            {
+                path[depth++] = node;
+                descendRight(node->left);
+                return *this;
+            }
+            while (depth > 0 && path[depth - 1]->left == node)
+            {
+                node = path[--depth];
+            }
+            node = (depth > 0) ? path[--depth] : nullptr;
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator before(*this);
+            --*this;
+            return before;
+        }
+
+        bool operator==(const const_iterator &other) const
+        {
+            return node == other.node;
+        }
+
+        bool operator!=(const const_iterator &other) const
+        {
+            return node != other.node;
+        }
+
+    private:
+        friend class BasicAVLTree;
+
+        explicit const_iterator(const BasicAVLTree *tree) : tree(tree), node(nullptr), depth(0) {}
+
+        void copyPath(const const_iterator &other)
+        {
+            for (int i = 0; i < depth; i++)
+            {
+                path[i] = other.path[i];
+            }
+        }
+
+        void descendLeft(const Node *from)
+        {
+            node = from;
+            while (node != nullptr && node->left != nullptr)
+            {
+                path[depth++] = node;
+                node = node->left;
+            }
+        }
+
+        void descendRight(const Node *from)
+        {
+            node = from;
+            while (node != nullptr && node->right != nullptr)
+            {
+                path[depth++] = node;
+                node = node->right;
+            }
+        }
+
+        const BasicAVLTree *tree;
+        const Node *node;           // nullptr for end()
+        int depth;                  // ancestors of node held in path
+        const Node *path[maxHeight];
+    };
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    std::vector<Key> *result = new std::vector<Key>();
+    BasicAVLTree();
+    explicit BasicAVLTree(const Compare &comp, const Alloc &alloc = Alloc(), NodePoolMode mode = NodePoolMode::Slab);
+    BasicAVLTree(const BasicAVLTree &) = delete;
+    BasicAVLTree &operator=(const BasicAVLTree &) = delete;
+    ~BasicAVLTree();
+    void insert(const Key &data);
+    void remove(const Key &data);
+    Key getRoot();
+    std::size_t getsize();
+    void inorderTraversal();
+    void preorderTraversal();
+    void postorderTraversal();
+    void levelOrderTraversal();
+    bool depthFirstSearch(const Key &key);
+    bool breadthFirstSearch(const Key &key);
+    int height();
+    Key minimum();
+    Key maximum();
+    void clear();
+    int count();
+    bool isBalanced();
+    Key successor(const Key &key);
+    Key predecessor(const Key &key);
+    void rangeSearch(const Key &k1, const Key &k2);
+    void updateKey(const Key &oldKey, const Key &newKey);
+
+    // Ordered O(log n) lookups; unlike depthFirstSearch/breadthFirstSearch
+    // they descend a single path and allocate nothing.
+    Node *find(const Key &key) const;
+    bool contains(const Key &key) const;
+
+    // Iteration in key order. lower_bound/upper_bound position an iterator
+    // in O(log n), so scanning k keys from there costs O(log n + k).
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+    const_iterator lower_bound(const Key &key) const;
+    const_iterator upper_bound(const Key &key) const;
+
+    // Batched lookups: out[i] is contains(keys[i]) / successor(keys[i]).
+    // Up to batchGroup descents advance in lockstep, one level per round,
+    // and each prefetches its next node, so their cache misses overlap
+    // instead of being paid one after another.
+    static const std::size_t batchGroup = 16;
+    void containsBatch(const Key *keys, std::size_t n, bool *out) const;
+    void successorBatch(const Key *keys, std::size_t n, Key *out) const;
+
+    // Binary snapshot of an integral-keyed tree: a 32-byte header (magic
+    // "AVLS", format version, key size, key count, payload length, CRC-32C
+    // of the header's first 28 bytes and the payload), then the keys in
+    // order, the first as a zigzag varint and each following one as the
+    // varint delta from its predecessor. deserialize_in replaces the
+    // contents with an O(n) bulk build; on a truncated, corrupt or
+    // incompatible snapshot it throws std::runtime_error and leaves the
+    // tree as it was. It never allocates for more bytes than the stream
+    // actually delivers, whatever the header claims.
+    static const std::uint32_t snapshotVersion = 2;
+    static const std::size_t snapshotHeaderSize = 32;
+    void serialize(std::ostream &out) const;
+    void deserialize_in(std::istream &in);
+
+    // Immutable Eytzinger-ordered copy of the keys for read-mostly use, in
+    // O(n); defined in FrozenSet.h.
+    BasicFrozenSet<Key, Compare> freeze() const;
+
+    // Allocation-free traversals. visit is called with each key and is
+    // inlined into the walk; if it returns bool, false stops the walk early
+    // and the visit* function returns false. The output-iterator overloads
+    // write the keys to out instead of appending to result.
+    template <typename Visitor>
+    bool visitInorder(Visitor visit) const;
+    template <typename Visitor>
+    bool visitPreorder(Visitor visit) const;
+    template <typename Visitor>
+    bool visitPostorder(Visitor visit) const;
+    template <typename Visitor>
+    bool visitLevelOrder(Visitor visit) const;
+    template <typename Visitor>
+    bool visitRange(const Key &k1, const Key &k2, Visitor visit) const;
+    template <typename OutputIt>
+    OutputIt inorderTraversal(OutputIt out) const;
+    template <typename OutputIt>
+    OutputIt preorderTraversal(OutputIt out) const;
+    template <typename OutputIt>
+    OutputIt postorderTraversal(OutputIt out) const;
+    template <typename OutputIt>
+    OutputIt levelOrderTraversal(OutputIt out) const;
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const;
+
+    // Order statistics from the subtree sizes, all O(log n). rank is the
+    // number of keys less than key; select(i) is the i-th smallest key
+    // (0-based); countRange counts the keys in [k1, k2] like rangeSearch
+    // reports them. median is the lower median and percentile(p) the
+    // nearest-rank p-th percentile, p in [0, 100]. Missing answers are -1.
+    std::size_t rank(const Key &key) const;
+    Key select(std::size_t index) const;
+    std::size_t countRange(const Key &k1, const Key &k2) const;
+    Key median() const;
+    Key percentile(double p) const;
+
+    // Replace the contents with the keys of [first, last) in O(n): the tree
+    // comes out perfectly balanced and its nodes are allocated as one block.
+    // buildFromSorted expects the range sorted by Compare; equal neighbours
+    // are kept once. buildFromUnsorted sorts and deduplicates a copy first.
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last);
+    template <typename InputIt>
+    void buildFromUnsorted(InputIt first, InputIt last);
+
+    // Set operations built on join/split, O(m log(n/m + 1)) for trees of
+    // sizes m <= n. They consume other: its nodes are moved into (or freed
+    // by) this tree and it is left empty. Both trees' allocators must compare equal.
+    void unionWith(BasicAVLTree &other);
+    void intersectWith(BasicAVLTree &other);
+    void differenceWith(BasicAVLTree &other);
+
+    // Insert or erase a batch of keys. The batch is sorted and deduplicated
+    // if needed and then pushed down the tree, each node passing on the part
+    // of the batch that falls in each of its subtrees: keys that share a
+    // path share its descent, and each affected subtree is rebalanced once,
+    // by a join, instead of once per key.
+    template <typename InputIt>
+    void insertBatch(InputIt first, InputIt last);
+    template <typename InputIt>
+    void eraseBatch(InputIt first, InputIt last);
+
+    // Parallel versions of the set operations: the two recursive halves of
+    // every step run as fork-join tasks on workers while the subproblem is
+    // larger than grainSize nodes. The result is the same tree shape as the
+    // sequential operation.
+    static const std::size_t defaultGrainSize = 8192;
+    void mergeFrom(BasicAVLTree &other, WorkStealingPool &workers = WorkStealingPool::global(), std::size_t grainSize = defaultGrainSize);
+    void parallelIntersectWith(BasicAVLTree &other, WorkStealingPool &workers = WorkStealingPool::global(), std::size_t grainSize = defaultGrainSize);
+    void parallelDifferenceWith(BasicAVLTree &other, WorkStealingPool &workers = WorkStealingPool::global(), std::size_t grainSize = defaultGrainSize);
+
+    // Node pool control. In Arena mode removed nodes are not recycled and
+    // clear() returns whole slabs to the allocator.
+    void setPoolMode(NodePoolMode mode);
+    NodePoolStats poolStats() const;
+
+    // Cache-oblivious node layout. relayout() moves every node, in O(n log log n),
+    // into one block in van Emde Boas order: each subtree of half the height
+    // sits contiguously, so a descent touches O(log_B n) blocks for any block
+    // size B. With a non-zero interval the tree relays itself after that many
+    // inserts, removes and updateKeys, and buildFromSorted/buildFromUnsorted
+    // leave it in this layout too. Both invalidate iterators and Node pointers.
+    void relayout();
+    void setRelayoutInterval(std::size_t mutations);
+};
+
+// The original int-keyed tree.
+typedef BasicAVLTree<int> AVLTree;
+
+template <typename Key, typename Compare, typename Alloc>
+const int BasicAVLTree<Key, Compare, Alloc>::maxHeight;
+
+template <typename Key, typename Compare, typename Alloc>
+const std::size_t BasicAVLTree<Key, Compare, Alloc>::batchGroup;
+
+template <typename Key, typename Compare, typename Alloc>
+const std::size_t BasicAVLTree<Key, Compare, Alloc>::batchWindow;
+
+template <typename Key, typename Compare, typename Alloc>
+const std::uint32_t BasicAVLTree<Key, Compare, Alloc>::snapshotVersion;
+
+template <typename Key, typename Compare, typename Alloc>
+const std::size_t BasicAVLTree<Key, Compare, Alloc>::snapshotHeaderSize;
+
+template <typename Key, typename Compare, typename Alloc>
+BasicAVLTree<Key, Compare, Alloc>::BasicAVLTree()
+{
+    root = nullptr;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+BasicAVLTree<Key, Compare, Alloc>::BasicAVLTree(const Compare &comp, const Alloc &alloc, NodePoolMode mode)
+    : comp(comp), pool(NodeAllocator(alloc), mode)
+{
+    root = nullptr;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::createNode(const Key &data)
+{
+    Node *node = pool.allocate();
+    NodeAllocTraits::construct(pool.allocator(), node, data);
+    return node;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::destroyNode(Node *node)
+{
+    NodeAllocTraits::destroy(pool.allocator(), node);
+    pool.deallocate(node);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::notFound()
+{
+    return avl_detail::missingKey<Key>(std::is_arithmetic<Key>());
+}
+
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::height(Node *node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+    return node->height;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::sizeOf(Node *node)
+{
+    return (node != nullptr) ? node->subtreeSize : 0;
+}
+
+// Recompute node's height and subtree size from its children.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::updateNode(Node *node)
+{
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->subtreeSize = static_cast<std::uint32_t>(1 + sizeOf(node->left) + sizeOf(node->right));
+}
+
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::getBalanceFactor(Node *node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+    return height(node->left) - height(node->right);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::rightRotate(Node *y)
+{
+    Node *x = y->left;
+    Node *T2 = x->right;
+
+    // Perform rotation
+    x->right = y;
+    y->left = T2;
+
+    // Update heights and subtree sizes
+    updateNode(y);
+    updateNode(x);
+
+    return x;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::leftRotate(Node *x)
+{
+    Node *y = x->right;
+    Node *T2 = y->left;
+
+    // Perform rotation
+    y->left = x;
+    x->right = T2;
+
+    // Update heights and subtree sizes
+    updateNode(x);
+    updateNode(y);
+
+    return y;
+}
+
+// Restore the AVL property at node once a child subtree's height changed by
+// one; returns the root of the (possibly rotated) subtree.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::rebalance(Node *node)
+{
+    updateNode(node);
+
+    int balance = getBalanceFactor(node);
+
+    // Left Left / Left Right Case
+    if (balance > 1)
+    {
+        if (getBalanceFactor(node->left) < 0)
+        {
+            node->left = leftRotate(node->left);
+        }
+        return rightRotate(node);
+    }
+
+    // Right Right / Right Left Case
+    if (balance < -1)
+    {
+        if (getBalanceFactor(node->right) > 0)
+        {
+            node->right = rightRotate(node->right);
+        }
+        return leftRotate(node);
+    }
+
+    return node;
+}
+
+// Walk back up the recorded path, rebalancing, until a subtree comes out
+// with the height it had before; above that point only the sizes change.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::retrace(Node **path[], int depth, int sizeDelta)
+{
+    while (depth > 0)
+    {
+        Node **link = path[--depth];
+        int oldHeight = (*link)->height;
+        *link = rebalance(*link);
+        if ((*link)->height == oldHeight)
+        {
+            break;
+        }
+    }
+    while (depth > 0)
+    {
+        Node *ancestor = *path[--depth];
+        ancestor->subtreeSize = static_cast<std::uint32_t>(ancestor->subtreeSize + sizeDelta);
+    }
+}
+
+// Descend from *link towards key, recording the link that points at each
+// visited node. On return *link is the empty slot where key belongs, or -1
+// tells that key is already present.
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::insertionPath(Node **&link, Node **path[], const Key &key)
+{
+    int depth = 0;
+    while (*link != nullptr)
+    {
+        Node *current = *link;
+        path[depth++] = link;
+        if (comp(key, current->data))
+        {
+            link = &current->left;
+        }
+        else if (comp(current->data, key))
+        {
+            link = &current->right;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return depth;
+}
+
+// Iterative insert: the search path is kept as the links that point at each
+// visited node, so rotations can be written straight back into the parent.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::insert(Node *node, const Key &data)
+{
+    Node **path[maxHeight];
+    Node **link = &node;
+    int depth = insertionPath(link, path, data);
+    if (depth < 0)
+    {
+        return node; // Duplicate keys not allowed
+    }
+
+    *link = createNode(data);
+    size++;
+    retrace(path, depth, 1);
+    return node;
+}
+
+// Link an unattached node, already holding its key, into root. Returns false
+// and leaves the tree alone if the key is present.
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::attachNode(Node *&root, Node *node)
+{
+    Node **path[maxHeight];
+    Node **link = &root;
+    int depth = insertionPath(link, path, node->data);
+    if (depth < 0)
+    {
+        return false;
+    }
+
+    node->left = node->right = nullptr;
+    node->height = 1;
+    node->subtreeSize = 1;
+    *link = node;
+    retrace(path, depth, 1);
+    return true;
+}
+
+// Unlink the node holding key from root without freeing it, or return nullptr
+// if key is absent. With two children the in-order successor's key moves into
+// the matching node and the successor's node is the one handed back.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::detachNode(Node *&root, const Key &key)
+{
+    Node **path[maxHeight];
+    int depth = 0;
+    Node **link = &root;
+
+    while (*link != nullptr && (comp(key, (*link)->data) || comp((*link)->data, key)))
+    {
+        Node *current = *link;
+        path[depth++] = link;
+        link = comp(key, current->data) ? &current->left : &current->right;
+    }
+    if (*link == nullptr)
+    {
+        return nullptr;
+    }
+
+    Node *target = *link;
+    if (target->left != nullptr && target->right != nullptr)
+    {
+        // Two children: take over the in-order successor's key and unlink the successor instead
+        path[depth++] = link;
+        link = &target->right;
+        while ((*link)->left != nullptr)
+        {
+            path[depth++] = link;
+            link = &(*link)->left;
+        }
+        Node *successor = *link;
+        target->data = std::move(successor->data);
+        target = successor;
+    }
+
+    // Zero or one child: splice the node out
+    *link = (target->left != nullptr) ? target->left : target->right;
+    retrace(path, depth, -1);
+    return target;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::deleteNode(Node *root, const Key &key)
+{
+    Node *removed = detachNode(root, key);
+    if (removed != nullptr)
+    {
+        destroyNode(removed);
+        size--;
+    }
+    return root;
+}
+
+// Morris traversal: the right link of each in-order predecessor is pointed
+// back at its successor on the way down and restored on the way up, so the
+// walk needs no stack at all. The tree is back in its original shape when
+// the walk returns, but it is being written to meanwhile; concurrent
+// readers must use the const visit* functions instead. result is reserved
+// up front so that no push_back can throw with links still threaded.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::inorderTraversal(Node *root)
+{
+    result->reserve(result->size() + sizeOf(root));
+    Node *node = root;
+    while (node != nullptr)
+    {
+        if (node->left == nullptr)
+        {
+            result->push_back(node->data);
+            node = node->right;
+            continue;
+        }
+        Node *predecessor = node->left;
+        while (predecessor->right != nullptr && predecessor->right != node)
+        {
+            predecessor = predecessor->right;
+        }
+        if (predecessor->right == nullptr)
+        {
+            predecessor->right = node;
+            node = node->left;
+        }
+        else
+        {
+            predecessor->right = nullptr;
+            result->push_back(node->data);
+            node = node->right;
+        }
+    }
+}
+
+// Morris traversal as above, emitting each node when its thread is laid
+// rather than when it is taken down.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::preorderTraversal(Node *root)
+{
+    result->reserve(result->size() + sizeOf(root));
+    Node *node = root;
+    while (node != nullptr)
+    {
+        if (node->left == nullptr)
+        {
+            result->push_back(node->data);
+            node = node->right;
+            continue;
+        }
+        Node *predecessor = node->left;
+        while (predecessor->right != nullptr && predecessor->right != node)
+        {
+            predecessor = predecessor->right;
+        }
+        if (predecessor->right == nullptr)
+        {
+            result->push_back(node->data);
+            predecessor->right = node;
+            node = node->left;
+        }
+        else
+        {
+            predecessor->right = nullptr;
+            node = node->right;
+        }
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::postorderTraversal(Node *root)
+{
+
+    if (root != nullptr)
+    {
+        postorderTraversal(root->left);
+        postorderTraversal(root->right);
+        result->push_back(root->data);
+    }
+}
+
+// Size levelBuffer for a breadth-first walk of root and return the index
+// mask. The queue never holds more than 2^(h-1) nodes (the most the widest
+// level of a tree of height h can have) nor more than the whole subtree, so
+// that bound, rounded up to a power of two, is all the buffer ever needs;
+// it is kept between walks.
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::reserveLevelBuffer(Node *root)
+{
+    std::size_t widest = sizeOf(root);
+    if (height(root) - 1 < 63)
+    {
+        widest = std::min(widest, std::size_t(1) << (height(root) - 1));
+    }
+    std::size_t capacity = 1;
+    while (capacity < widest)
+    {
+        capacity *= 2;
+    }
+    if (levelBuffer.size() < capacity)
+    {
+        levelBuffer.resize(capacity);
+    }
+    return levelBuffer.size() - 1;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::levelOrderTraversal(Node *root)
+{
+    if (root == nullptr)
+    {
+        return;
+    }
+
+    std::size_t mask = reserveLevelBuffer(root);
+    std::size_t head = 0;
+    std::size_t tail = 0;
+    levelBuffer[tail++ & mask] = root;
+
+    while (head != tail)
+    {
+        Node *temp = levelBuffer[head++ & mask];
+        result->push_back(temp->data);
+
+        if (temp->left != nullptr)
+        {
+            levelBuffer[tail++ & mask] = temp->left;
+        }
+        if (temp->right != nullptr)
+        {
+            levelBuffer[tail++ & mask] = temp->right;
+        }
+    }
+    return;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::findMin(Node *root)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+    while (root->left != nullptr)
+    {
+        root = root->left;
+    }
+    return root;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::findMax(Node *root)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+    while (root->right != nullptr)
+    {
+        root = root->right;
+    }
+    return root;
+}
+
+// Destroy every node with O(1) extra memory: rotate left children up until
+// the current node has none, then destroy it and continue down its right
+// spine. Each rotation moves one node onto that spine for good, so the
+// whole teardown is O(n).
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::clear(Node *root)
+{
+    while (root != nullptr)
+    {
+        if (root->left != nullptr)
+        {
+            Node *left = root->left;
+            root->left = left->right;
+            left->right = root;
+            root = left;
+        }
+        else
+        {
+            Node *right = root->right;
+            destroyNode(root);
+            root = right;
+        }
+    }
+}
+
+// The walks below go down left links and stack only the right children
+// still to be visited, which never exceeds the height of the tree.
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::countNodes(Node *root)
+{
+    Node *pending[maxHeight];
+    int depth = 0;
+    int count = 0;
+    for (Node *node = root; node != nullptr || depth > 0; node = node->left)
+    {
+        if (node == nullptr)
+        {
+            node = pending[--depth];
+        }
+        count++;
+        if (node->right != nullptr)
+        {
+            pending[depth++] = node->right;
+        }
+    }
+    return count;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::isBalanced(Node *root)
+{
+    Node *pending[maxHeight];
+    int depth = 0;
+    for (Node *node = root; node != nullptr || depth > 0; node = node->left)
+    {
+        if (node == nullptr)
+        {
+            node = pending[--depth];
+        }
+        int balance = getBalanceFactor(node);
+        if (balance < -1 || balance > 1)
+        {
+            return false;
+        }
+        if (node->right != nullptr)
+        {
+            pending[depth++] = node->right;
+        }
+    }
+    return true;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::findSuccessor(Node *root, const Key &key)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+    Node *successor = nullptr;
+    while (root != nullptr)
+    {
+        if (comp(key, root->data))
+        {
+            successor = root;
+            root = root->left;
+        }
+        else
+        {
+            root = root->right;
+        }
+    }
+    return successor;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::findPredecessor(Node *root, const Key &key)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+    Node *predecessor = nullptr;
+    while (root != nullptr)
+    {
+        if (comp(root->data, key))
+        {
+            predecessor = root;
+            root = root->right;
+        }
+        else
+        {
+            root = root->left;
+        }
+    }
+    return predecessor;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::rangeSearch(Node *root, const Key &k1, const Key &k2)
+{
+    if (root == nullptr)
+    {
+        return;
+    }
+    if (comp(k1, root->data))
+    {
+        rangeSearch(root->left, k1, k2);
+    }
+    if (!comp(root->data, k1) && !comp(k2, root->data))
+    {
+        result->push_back(root->data);
+    }
+    if (comp(root->data, k2))
+    {
+        rangeSearch(root->right, k1, k2);
+    }
+}
+
+// Rename oldKey to newKey in O(log n). If newKey still sorts between the
+// node's in-order neighbours the key is rewritten in place; otherwise the
+// node is unlinked and linked again at its new position without being freed.
+// Renaming onto a key that is already present just removes oldKey.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::updateKey(Node *root, const Key &oldKey, const Key &newKey)
+{
+    Node *node = root;
+    Node *lower = nullptr;
+    Node *upper = nullptr;
+    while (node != nullptr && (comp(oldKey, node->data) || comp(node->data, oldKey)))
+    {
+        if (comp(oldKey, node->data))
+        {
+            upper = node;
+            node = node->left;
+        }
+        else
+        {
+            lower = node;
+            node = node->right;
+        }
+    }
+    if (node == nullptr || !(comp(oldKey, newKey) || comp(newKey, oldKey)))
+    {
+        return root;
+    }
+
+    Node *predecessor = (node->left != nullptr) ? findMax(node->left) : lower;
+    Node *successor = (node->right != nullptr) ? findMin(node->right) : upper;
+    if ((predecessor == nullptr || comp(predecessor->data, newKey)) && (successor == nullptr || comp(newKey, successor->data)))
+    {
+        node->data = newKey;
+        return root;
+    }
+
+    Node *moved = detachNode(root, oldKey);
+    moved->data = newKey;
+    if (!attachNode(root, moved))
+    {
+        destroyNode(moved);
+        size--;
+    }
+    return root;
+}
+
+// Smallest node whose key is not less than key, or nullptr.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::lowerBound(Node *root, const Key &key) const
+{
+    Node *bound = nullptr;
+    while (root != nullptr)
+    {
+        if (comp(root->data, key))
+        {
+            root = root->right;
+        }
+        else
+        {
+            bound = root;
+            root = root->left;
+        }
+    }
+    return bound;
+}
+
+// Smallest node whose key is greater than key, or nullptr.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::upperBound(Node *root, const Key &key) const
+{
+    Node *bound = nullptr;
+    while (root != nullptr)
+    {
+        if (comp(key, root->data))
+        {
+            bound = root;
+            root = root->left;
+        }
+        else
+        {
+            root = root->right;
+        }
+    }
+    return bound;
+}
+
+// One comparison per level: find the lower bound, then test it for equality once.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::find(Node *root, const Key &key) const
+{
+    Node *candidate = lowerBound(root, key);
+    if (candidate != nullptr && !comp(key, candidate->data))
+    {
+        return candidate;
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::rank(Node *root, const Key &key) const
+{
+    std::size_t less = 0;
+    while (root != nullptr)
+    {
+        if (comp(root->data, key))
+        {
+            less += sizeOf(root->left) + 1;
+            root = root->right;
+        }
+        else
+        {
+            root = root->left;
+        }
+    }
+    return less;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::selectNode(Node *root, std::size_t index) const
+{
+    while (root != nullptr)
+    {
+        std::size_t leftSize = sizeOf(root->left);
+        if (index < leftSize)
+        {
+            root = root->left;
+        }
+        else if (index == leftSize)
+        {
+            return root;
+        }
+        else
+        {
+            index -= leftSize + 1;
+            root = root->right;
+        }
+    }
+    return nullptr;
+}
+
+// Builds the subtree holding the next count distinct keys, in order, so the
+// nodes are consumed from block (and the keys from next) sequentially.
+template <typename Key, typename Compare, typename Alloc>
+template <typename ForwardIt>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::buildBalanced(ForwardIt &next, ForwardIt last, Node *&block, std::size_t count, int &height)
+{
+    if (count == 0)
+    {
+        height = 0;
+        return nullptr;
+    }
+
+    std::size_t leftCount = (count - 1) / 2;
+    int leftHeight, rightHeight;
+    Node *left = buildBalanced(next, last, block, leftCount, leftHeight);
+
+    Node *node = block++;
+    NodeAllocTraits::construct(pool.allocator(), node, *next);
+    // Skip keys equal to the one just placed
+    for (++next; next != last && !comp(node->data, *next); ++next)
+    {
+    }
+
+    node->left = left;
+    node->right = buildBalanced(next, last, block, count - 1 - leftCount, rightHeight);
+    node->height = 1 + std::max(leftHeight, rightHeight);
+    node->subtreeSize = static_cast<std::uint32_t>(count);
+    height = node->height;
+    return node;
+}
+
+// left is taller than right by more than one: walk down left's right spine to
+// a subtree of right's height, hang middle there and rotate back up.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::joinRight(Node *left, Node *middle, Node *right)
+{
+    Node *spine = left->right;
+    if (height(spine) <= height(right) + 1)
+    {
+        middle->left = spine;
+        middle->right = right;
+        updateNode(middle);
+        if (height(middle) <= height(left->left) + 1)
+        {
+            left->right = middle;
+            updateNode(left);
+            return left;
+        }
+        left->right = rightRotate(middle);
+        updateNode(left);
+        return leftRotate(left);
+    }
+
+    left->right = joinRight(spine, middle, right);
+    updateNode(left);
+    if (height(left->right) <= height(left->left) + 1)
+    {
+        return left;
+    }
+    return leftRotate(left);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::joinLeft(Node *left, Node *middle, Node *right)
+{
+    Node *spine = right->left;
+    if (height(spine) <= height(left) + 1)
+    {
+        middle->left = left;
+        middle->right = spine;
+        updateNode(middle);
+        if (height(middle) <= height(right->right) + 1)
+        {
+            right->left = middle;
+            updateNode(right);
+            return right;
+        }
+        right->left = leftRotate(middle);
+        updateNode(right);
+        return rightRotate(right);
+    }
+
+    right->left = joinLeft(left, middle, spine);
+    updateNode(right);
+    if (height(right->left) <= height(right->right) + 1)
+    {
+        return right;
+    }
+    return rightRotate(right);
+}
+
+// Join two AVL trees around middle, where every key of left < middle's key <
+// every key of right. O(|height(left) - height(right)| + 1).
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::join(Node *left, Node *middle, Node *right)
+{
+    if (height(left) > height(right) + 1)
+    {
+        return joinRight(left, middle, right);
+    }
+    if (height(right) > height(left) + 1)
+    {
+        return joinLeft(left, middle, right);
+    }
+    middle->left = left;
+    middle->right = right;
+    updateNode(middle);
+    return middle;
+}
+
+// Detach the largest node of root into last and return the rest of the tree.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::splitLast(Node *root, Node *&last)
+{
+    if (root->right == nullptr)
+    {
+        last = root;
+        return root->left;
+    }
+    Node *rest = splitLast(root->right, last);
+    return join(root->left, root, rest);
+}
+
+// Join without a middle key: every key of left < every key of right.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::concat(Node *left, Node *right)
+{
+    if (left == nullptr)
+    {
+        return right;
+    }
+    Node *last;
+    Node *rest = splitLast(left, last);
+    return join(rest, last, right);
+}
+
+// Split root into the keys less than key (left), the node equal to key if any
+// (match) and the keys greater than key (right), in O(height).
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::split(Node *root, const Key &key, Node *&left, Node *&match, Node *&right)
+{
+    if (root == nullptr)
+    {
+        left = match = right = nullptr;
+        return;
+    }
+    if (comp(key, root->data))
+    {
+        Node *greater;
+        split(root->left, key, left, match, greater);
+        right = join(greater, root, root->right);
+    }
+    else if (comp(root->data, key))
+    {
+        Node *less;
+        split(root->right, key, less, match, right);
+        left = join(root->left, root, less);
+    }
+    else
+    {
+        left = root->left;
+        match = root;
+        right = root->right;
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::worthForking(Node *a, Node *b, WorkStealingPool *workers, std::size_t grainSize)
+{
+    if (workers == nullptr || workers->size() == 1)
+    {
+        return false;
+    }
+    return sizeOf(a) + sizeOf(b) > grainSize;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::unionOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize)
+{
+    if (a == nullptr)
+    {
+        return b;
+    }
+    if (b == nullptr)
+    {
+        return a;
+    }
+    Node *less, *match, *greater;
+    split(b, a->data, less, match, greater);
+    if (match != nullptr)
+    {
+        dropped.push(match);
+    }
+    Node *aLeft = a->left;
+    Node *aRight = a->right;
+    Node *left, *right;
+    if (worthForking(a, b, workers, grainSize))
+    {
+        DroppedNodes droppedRight;
+        workers->invoke([&]() { left = unionOf(aLeft, less, dropped, workers, grainSize); },
+                        [&]() { right = unionOf(aRight, greater, droppedRight, workers, grainSize); });
+        dropped.append(droppedRight);
+    }
+    else
+    {
+        left = unionOf(aLeft, less, dropped, workers, grainSize);
+        right = unionOf(aRight, greater, dropped, workers, grainSize);
+    }
+    return join(left, a, right);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::intersectionOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize)
+{
+    if (a == nullptr || b == nullptr)
+    {
+        dropped.pushTree(a);
+        dropped.pushTree(b);
+        return nullptr;
+    }
+    Node *less, *match, *greater;
+    split(b, a->data, less, match, greater);
+    Node *aLeft = a->left;
+    Node *aRight = a->right;
+    Node *left, *right;
+    if (worthForking(a, b, workers, grainSize))
+    {
+        DroppedNodes droppedRight;
+        workers->invoke([&]() { left = intersectionOf(aLeft, less, dropped, workers, grainSize); },
+                        [&]() { right = intersectionOf(aRight, greater, droppedRight, workers, grainSize); });
+        dropped.append(droppedRight);
+    }
+    else
+    {
+        left = intersectionOf(aLeft, less, dropped, workers, grainSize);
+        right = intersectionOf(aRight, greater, dropped, workers, grainSize);
+    }
+    if (match != nullptr)
+    {
+        dropped.push(match);
+        return join(left, a, right);
+    }
+    dropped.push(a);
+    return concat(left, right);
+}
+
+// Keys of a that are not in b; every node of b is dropped.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::differenceOf(Node *a, Node *b, DroppedNodes &dropped, WorkStealingPool *workers, std::size_t grainSize)
+{
+    if (a == nullptr || b == nullptr)
+    {
+        dropped.pushTree(b);
+        return a;
+    }
+    Node *less, *match, *greater;
+    split(a, b->data, less, match, greater);
+    if (match != nullptr)
+    {
+        dropped.push(match);
+    }
+    Node *bLeft = b->left;
+    Node *bRight = b->right;
+    dropped.push(b);
+    Node *left, *right;
+    if (worthForking(less, greater, workers, grainSize))
+    {
+        DroppedNodes droppedRight;
+        workers->invoke([&]() { left = differenceOf(less, bLeft, dropped, workers, grainSize); },
+                        [&]() { right = differenceOf(greater, bRight, droppedRight, workers, grainSize); });
+        dropped.append(droppedRight);
+    }
+    else
+    {
+        left = differenceOf(less, bLeft, dropped, workers, grainSize);
+        right = differenceOf(greater, bRight, dropped, workers, grainSize);
+    }
+    return concat(left, right);
+}
+
+// Run a set operation against other, then free whatever it dropped.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::combineWith(BasicAVLTree &other, SetOperation operation, WorkStealingPool *workers, std::size_t grainSize)
+{
+    pool.adopt(other.pool);
+    size += other.size;
+    Node *otherRoot = other.root;
+    other.root = nullptr;
+    other.size = 0;
+
+    DroppedNodes dropped;
+    if (workers != nullptr)
+    {
+        workers->run([&]() { root = (this->*operation)(root, otherRoot, dropped, workers, grainSize); });
+    }
+    else
+    {
+        root = (this->*operation)(root, otherRoot, dropped, nullptr, grainSize);
+    }
+
+    for (Node *node = dropped.head; node != nullptr;)
+    {
+        Node *next = node->left;
+        destroyNode(node);
+        node = next;
+    }
+    size -= dropped.count;
+}
+
+// Both batch walks descend the tree itself, handing each child the part of
+// the batch that falls on its side, so only the nodes on the paths to the
+// batch's keys are visited. A subtree the batch missed is returned as is;
+// every visited node is put back with join, which restores balance in
+// O(height difference) however much its subtrees grew or shrank.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::insertSorted(Node *root, const Key *first, const Key *last, std::size_t &added)
+{
+    if (first == last)
+    {
+        return root;
+    }
+    if (root == nullptr)
+    {
+        // Nothing left to merge with: build the rest of the batch balanced
+        const Key *middle = first + (last - first) / 2;
+        Node *node = createNode(*middle);
+        added++;
+        node->left = insertSorted(nullptr, first, middle, added);
+        node->right = insertSorted(nullptr, middle + 1, last, added);
+        updateNode(node);
+        return node;
+    }
+    const Key *split = std::lower_bound(first, last, root->data, comp);
+    const Key *greater = (split != last && !comp(root->data, *split)) ? split + 1 : split;
+    Node *left = insertSorted(root->left, first, split, added);
+    Node *right = insertSorted(root->right, greater, last, added);
+    return join(left, root, right);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::eraseSorted(Node *root, const Key *first, const Key *last, DroppedNodes &dropped)
+{
+    if (root == nullptr || first == last)
+    {
+        return root;
+    }
+    const Key *split = std::lower_bound(first, last, root->data, comp);
+    bool match = split != last && !comp(root->data, *split);
+    Node *left = eraseSorted(root->left, first, split, dropped);
+    Node *right = eraseSorted(root->right, match ? split + 1 : split, last, dropped);
+    if (match)
+    {
+        dropped.push(root);
+        return concat(left, right);
+    }
+    return join(left, root, right);
+}
+
+// Touch every node a batch walk over [first, last) will visit, one tree
+// level at a time. All nodes of a level are independent, so their misses
+// overlap, and the recursive walk that follows finds its paths in cache
+// instead of taking each miss in turn. Batches are merged batchWindow keys
+// at a time so that the warmed paths still fit in cache when walked.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::prefetchBatchPaths(const Key *first, const Key *last) const
+{
+    struct Visit
+    {
+        const Node *node;
+        const Key *first;
+        const Key *last;
+    };
+    std::vector<Visit> level, next;
+    if (root != nullptr && first != last)
+    {
+        level.push_back(Visit{root, first, last});
+    }
+    while (!level.empty())
+    {
+        next.clear();
+        for (std::size_t i = 0; i < level.size(); i++)
+        {
+            const Visit &visit = level[i];
+            const Key *split = std::lower_bound(visit.first, visit.last, visit.node->data, comp);
+            const Key *greater = (split != visit.last && !comp(visit.node->data, *split)) ? split + 1 : split;
+            if (visit.node->left != nullptr && visit.first != split)
+            {
+                avl_detail::prefetch(visit.node->left);
+                next.push_back(Visit{visit.node->left, visit.first, split});
+            }
+            if (visit.node->right != nullptr && greater != visit.last)
+            {
+                avl_detail::prefetch(visit.node->right);
+                next.push_back(Visit{visit.node->right, greater, visit.last});
+            }
+        }
+        level.swap(next);
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename InputIt>
+std::vector<Key> BasicAVLTree<Key, Compare, Alloc>::sortedBatch(InputIt first, InputIt last, const Compare &comp)
+{
+    std::vector<Key> keys(first, last);
+    if (!std::is_sorted(keys.begin(), keys.end(), comp))
+    {
+        std::sort(keys.begin(), keys.end(), comp);
+    }
+    keys.erase(std::unique(keys.begin(), keys.end(), [&comp](const Key &a, const Key &b) { return !comp(a, b) && !comp(b, a); }), keys.end());
+    return keys;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename InputIt>
+void BasicAVLTree<Key, Compare, Alloc>::insertBatch(InputIt first, InputIt last)
+{
+    std::vector<Key> keys = sortedBatch(first, last, comp);
+    std::size_t added = 0;
+    for (std::size_t begin = 0; begin < keys.size(); begin += batchWindow)
+    {
+        const Key *window = keys.data() + begin;
+        const Key *windowEnd = keys.data() + std::min(keys.size(), begin + batchWindow);
+        prefetchBatchPaths(window, windowEnd);
+        root = insertSorted(root, window, windowEnd, added);
+    }
+    size += added;
+    noteMutations(added);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename InputIt>
+void BasicAVLTree<Key, Compare, Alloc>::eraseBatch(InputIt first, InputIt last)
+{
+    std::vector<Key> keys = sortedBatch(first, last, comp);
+    DroppedNodes dropped;
+    for (std::size_t begin = 0; begin < keys.size(); begin += batchWindow)
+    {
+        const Key *window = keys.data() + begin;
+        const Key *windowEnd = keys.data() + std::min(keys.size(), begin + batchWindow);
+        prefetchBatchPaths(window, windowEnd);
+        root = eraseSorted(root, window, windowEnd, dropped);
+    }
+    for (Node *node = dropped.head; node != nullptr;)
+    {
+        Node *next = node->left;
+        destroyNode(node);
+        node = next;
+    }
+    size -= dropped.count;
+    noteMutations(dropped.count);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::breadthFirstSearch(Node *root, const Key &key)
+{
+    if (root == nullptr)
+    {
+        return false;
+    }
+
+    std::size_t mask = reserveLevelBuffer(root);
+    std::size_t head = 0;
+    std::size_t tail = 0;
+    levelBuffer[tail++ & mask] = root;
+
+    while (head != tail)
+    {
+        Node *current = levelBuffer[head++ & mask];
+
+        if (!comp(current->data, key) && !comp(key, current->data))
+        {
+            return true;
+        }
+
+        if (current->left != nullptr)
+        {
+            levelBuffer[tail++ & mask] = current->left;
+        }
+
+        if (current->right != nullptr)
+        {
+            levelBuffer[tail++ & mask] = current->right;
+        }
+    }
+
+    return false;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::depthFirstSearch(Node *root, const Key &key)
+{
+    Node *pending[maxHeight];
+    int depth = 0;
+    for (Node *node = root; node != nullptr || depth > 0; node = node->left)
+    {
+        if (node == nullptr)
+        {
+            node = pending[--depth];
+        }
+        if (!comp(node->data, key) && !comp(key, node->data))
+        {
+            return true;
+        }
+        if (node->right != nullptr)
+        {
+            pending[depth++] = node->right;
+        }
+    }
+    return false;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::getsize()
+{
+    return size;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::getRoot()
+{
+    return root->data;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::depthFirstSearch(const Key &key)
+{
+    return depthFirstSearch(root, key);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::breadthFirstSearch(const Key &key)
+{
+    if (root)
+    {
+        return breadthFirstSearch(root, key);
+    }
+    return false;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::insert(const Key &data)
+{
+    std::size_t before = size;
+    root = insert(root, data);
+    noteMutations(size - before);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::remove(const Key &data)
+{
+    if (root)
+    {
+        std::size_t before = size;
+        root = deleteNode(root, data);
+        noteMutations(before - size);
+        return;
+    }
+    return;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::inorderTraversal()
+{
+    return inorderTraversal(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::preorderTraversal()
+{
+    return preorderTraversal(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::postorderTraversal()
+{
+    return postorderTraversal(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::levelOrderTraversal()
+{
+    return levelOrderTraversal(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::height()
+{
+    return height(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::minimum()
+{
+    Node *minNode = findMin(root);
+    return (minNode != nullptr) ? minNode->data : notFound();
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::maximum()
+{
+    Node *maxNode = findMax(root);
+    return (maxNode != nullptr) ? maxNode->data : notFound();
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::clear()
+{
+    // Nodes with trivially destructible keys need no visit: the pool drops
+    // them all at once, in time proportional to the number of slabs
+    if (!std::is_trivially_destructible<Node>::value)
+    {
+        clear(root);
+    }
+    pool.reset();
+    root = nullptr;
+    size = 0;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+int BasicAVLTree<Key, Compare, Alloc>::count()
+{
+    return countNodes(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::isBalanced()
+{
+    return isBalanced(root);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::successor(const Key &key)
+{
+    Node *successorNode = findSuccessor(root, key);
+    return (successorNode != nullptr) ? successorNode->data : notFound();
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::predecessor(const Key &key)
+{
+    Node *predecessorNode = findPredecessor(root, key);
+    return (predecessorNode != nullptr) ? predecessorNode->data : notFound();
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::rangeSearch(const Key &k1, const Key &k2)
+{
+    rangeSearch(root, k1, k2);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::updateKey(const Key &oldKey, const Key &newKey)
+{
+    if (root)
+    {
+        root = updateKey(root, oldKey, newKey);
+        noteMutations(1);
+        return;
+    }
+    return;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::Node *BasicAVLTree<Key, Compare, Alloc>::find(const Key &key) const
+{
+    return find(root, key);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+bool BasicAVLTree<Key, Compare, Alloc>::contains(const Key &key) const
+{
+    return find(root, key) != nullptr;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::containsBatch(const Key *keys, std::size_t n, bool *out) const
+{
+    for (std::size_t base = 0; base < n; base += batchGroup)
+    {
+        std::size_t group = std::min(batchGroup, n - base);
+        const Node *cursor[batchGroup];
+        for (std::size_t i = 0; i < group; i++)
+        {
+            cursor[i] = root;
+            out[base + i] = false;
+        }
+
+        for (bool active = true; active;)
+        {
+            active = false;
+            for (std::size_t i = 0; i < group; i++)
+            {
+                const Node *node = cursor[i];
+                if (node == nullptr)
+                {
+                    continue;
+                }
+                const Key &key = keys[base + i];
+                if (comp(key, node->data))
+                {
+                    node = node->left;
+                }
+                else if (comp(node->data, key))
+                {
+                    node = node->right;
+                }
+                else
+                {
+                    out[base + i] = true;
+                    node = nullptr;
+                }
+                if (node != nullptr)
+                {
+                    avl_detail::prefetch(node);
+                    active = true;
+                }
+                cursor[i] = node;
+            }
+        }
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::successorBatch(const Key *keys, std::size_t n, Key *out) const
+{
+    for (std::size_t base = 0; base < n; base += batchGroup)
+    {
+        std::size_t group = std::min(batchGroup, n - base);
+        const Node *cursor[batchGroup];
+        const Node *candidate[batchGroup];
+        for (std::size_t i = 0; i < group; i++)
+        {
+            cursor[i] = root;
+            candidate[i] = nullptr;
+        }
+
+        for (bool active = true; active;)
+        {
+            active = false;
+            for (std::size_t i = 0; i < group; i++)
+            {
+                const Node *node = cursor[i];
+                if (node == nullptr)
+                {
+                    continue;
+                }
+                if (comp(keys[base + i], node->data))
+                {
+                    candidate[i] = node;
+                    node = node->left;
+                }
+                else
+                {
+                    node = node->right;
+                }
+                if (node != nullptr)
+                {
+                    avl_detail::prefetch(node);
+                    active = true;
+                }
+                cursor[i] = node;
+            }
+        }
+
+        for (std::size_t i = 0; i < group; i++)
+        {
+            out[base + i] = (candidate[i] != nullptr) ? candidate[i]->data : notFound();
+        }
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_iterator BasicAVLTree<Key, Compare, Alloc>::begin() const
+{
+    const_iterator it(this);
+    it.descendLeft(root);
+    return it;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_iterator BasicAVLTree<Key, Compare, Alloc>::end() const
+{
+    return const_iterator(this);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_reverse_iterator BasicAVLTree<Key, Compare, Alloc>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_reverse_iterator BasicAVLTree<Key, Compare, Alloc>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+// Same descent as lowerBound(), keeping the path; the bound is the last node
+// where the search turned left, so the path above it holds its ancestors.
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_iterator BasicAVLTree<Key, Compare, Alloc>::lower_bound(const Key &key) const
+{
+    const_iterator it(this);
+    int boundDepth = 0;
+    for (Node *node = root; node != nullptr;)
+    {
+        if (comp(node->data, key))
+        {
+            it.path[it.depth++] = node;
+            node = node->right;
+        }
+        else
+        {
+            it.node = node;
+            boundDepth = it.depth;
+            it.path[it.depth++] = node;
+            node = node->left;
+        }
+    }
+    it.depth = boundDepth;
+    return it;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+typename BasicAVLTree<Key, Compare, Alloc>::const_iterator BasicAVLTree<Key, Compare, Alloc>::upper_bound(const Key &key) const
+{
+    const_iterator it(this);
+    int boundDepth = 0;
+    for (Node *node = root; node != nullptr;)
+    {
+        if (comp(key, node->data))
+        {
+            it.node = node;
+            boundDepth = it.depth;
+            it.path[it.depth++] = node;
+            node = node->left;
+        }
+        else
+        {
+            it.path[it.depth++] = node;
+            node = node->right;
+        }
+    }
+    it.depth = boundDepth;
+    return it;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitInorder(Node *root, Visitor &visit) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    return visitInorder(root->left, visit) && avl_detail::keepVisiting(visit, root->data) &&
+           visitInorder(root->right, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitPreorder(Node *root, Visitor &visit) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    return avl_detail::keepVisiting(visit, root->data) && visitPreorder(root->left, visit) &&
+           visitPreorder(root->right, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitPostorder(Node *root, Visitor &visit) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    return visitPostorder(root->left, visit) && visitPostorder(root->right, visit) &&
+           avl_detail::keepVisiting(visit, root->data);
+}
+
+// Visit the nodes exactly level steps below root, left to right.
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitLevel(Node *root, int level, Visitor &visit) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    if (level == 0)
+    {
+        return avl_detail::keepVisiting(visit, root->data);
+    }
+    return visitLevel(root->left, level - 1, visit) && visitLevel(root->right, level - 1, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitRange(Node *root, const Key &k1, const Key &k2, Visitor &visit) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    if (comp(k1, root->data) && !visitRange(root->left, k1, k2, visit))
+    {
+        return false;
+    }
+    if (!comp(root->data, k1) && !comp(k2, root->data) && !avl_detail::keepVisiting(visit, root->data))
+    {
+        return false;
+    }
+    if (comp(root->data, k2))
+    {
+        return visitRange(root->right, k1, k2, visit);
+    }
+    return true;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitInorder(Visitor visit) const
+{
+    return visitInorder(root, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitPreorder(Visitor visit) const
+{
+    return visitPreorder(root, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitPostorder(Visitor visit) const
+{
+    return visitPostorder(root, visit);
+}
+
+// Level by level from the root instead of through a queue, so nothing is
+// allocated and the walk stays const. Each level restarts from the root
+// and revisits every node above it, which costs O(n log n) in the worst
+// case; it approaches O(n) only when the tree is close to perfect, with
+// each level about as full as all the levels above it together.
+// levelOrderTraversal() uses a bounded queue instead.
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitLevelOrder(Visitor visit) const
+{
+    for (int level = 0; level < height(root); level++)
+    {
+        if (!visitLevel(root, level, visit))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename Visitor>
+bool BasicAVLTree<Key, Compare, Alloc>::visitRange(const Key &k1, const Key &k2, Visitor visit) const
+{
+    return visitRange(root, k1, k2, visit);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename OutputIt>
+OutputIt BasicAVLTree<Key, Compare, Alloc>::inorderTraversal(OutputIt out) const
+{
+    visitInorder([&out](const Key &key) { *out++ = key; });
+    return out;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename OutputIt>
+OutputIt BasicAVLTree<Key, Compare, Alloc>::preorderTraversal(OutputIt out) const
+{
+    visitPreorder([&out](const Key &key) { *out++ = key; });
+    return out;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename OutputIt>
+OutputIt BasicAVLTree<Key, Compare, Alloc>::postorderTraversal(OutputIt out) const
+{
+    visitPostorder([&out](const Key &key) { *out++ = key; });
+    return out;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename OutputIt>
+OutputIt BasicAVLTree<Key, Compare, Alloc>::levelOrderTraversal(OutputIt out) const
+{
+    visitLevelOrder([&out](const Key &key) { *out++ = key; });
+    return out;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename OutputIt>
+OutputIt BasicAVLTree<Key, Compare, Alloc>::rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+{
+    visitRange(k1, k2, [&out](const Key &key) { *out++ = key; });
+    return out;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::rank(const Key &key) const
+{
+    return rank(root, key);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::select(std::size_t index) const
+{
+    Node *selected = selectNode(root, index);
+    return (selected != nullptr) ? selected->data : notFound();
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::size_t BasicAVLTree<Key, Compare, Alloc>::countRange(const Key &k1, const Key &k2) const
+{
+    if (comp(k2, k1))
+    {
+        return 0;
+    }
+    // Keys not above k2 minus keys below k1, each counted along one path
+    std::size_t notAbove = 0;
+    for (Node *node = root; node != nullptr;)
+    {
+        if (comp(k2, node->data))
+        {
+            node = node->left;
+        }
+        else
+        {
+            notAbove += sizeOf(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return notAbove - rank(root, k1);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::median() const
+{
+    if (root == nullptr)
+    {
+        return notFound();
+    }
+    return select((sizeOf(root) - 1) / 2);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+Key BasicAVLTree<Key, Compare, Alloc>::percentile(double p) const
+{
+    std::size_t n = sizeOf(root);
+    if (n == 0 || !(p >= 0 && p <= 100))
+    {
+        return notFound();
+    }
+    std::size_t nearestRank = static_cast<std::size_t>(std::ceil(p / 100 * n));
+    return select(nearestRank == 0 ? 0 : nearestRank - 1);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename ForwardIt>
+void BasicAVLTree<Key, Compare, Alloc>::buildFromSorted(ForwardIt first, ForwardIt last)
+{
+    // The whole tree goes into one new block, so the slabs clear() keeps
+    // would only sit idle beside it, one more per rebuild
+    clear();
+    pool.release();
+
+    std::size_t distinct = 0;
+    for (ForwardIt it = first; it != last; distinct++)
+    {
+        ForwardIt previous = it;
+        for (++it; it != last && !comp(*previous, *it); ++it)
+        {
+        }
+    }
+    if (distinct == 0)
+    {
+        return;
+    }
+
+    Node *block = pool.allocateBlock(distinct);
+    int treeHeight;
+    root = buildBalanced(first, last, block, distinct, treeHeight);
+    size = distinct;
+    if (relayoutInterval != 0)
+    {
+        relayout();
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+template <typename InputIt>
+void BasicAVLTree<Key, Compare, Alloc>::buildFromUnsorted(InputIt first, InputIt last)
+{
+    std::vector<Key> keys(first, last);
+    std::sort(keys.begin(), keys.end(), comp);
+    buildFromSorted(keys.begin(), keys.end());
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::unionWith(BasicAVLTree &other)
+{
+    if (&other != this)
+    {
+        combineWith(other, &BasicAVLTree::unionOf, nullptr, 0);
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::intersectWith(BasicAVLTree &other)
+{
+    if (&other != this)
+    {
+        combineWith(other, &BasicAVLTree::intersectionOf, nullptr, 0);
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::differenceWith(BasicAVLTree &other)
+{
+    if (&other == this)
+    {
+        clear();
+        return;
+    }
+    combineWith(other, &BasicAVLTree::differenceOf, nullptr, 0);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+const std::size_t BasicAVLTree<Key, Compare, Alloc>::defaultGrainSize;
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::mergeFrom(BasicAVLTree &other, WorkStealingPool &workers, std::size_t grainSize)
+{
+    if (&other != this)
+    {
+        combineWith(other, &BasicAVLTree::unionOf, &workers, grainSize);
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::parallelIntersectWith(BasicAVLTree &other, WorkStealingPool &workers, std::size_t grainSize)
+{
+    if (&other != this)
+    {
+        combineWith(other, &BasicAVLTree::intersectionOf, &workers, grainSize);
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::parallelDifferenceWith(BasicAVLTree &other, WorkStealingPool &workers, std::size_t grainSize)
+{
+    if (&other == this)
+    {
+        clear();
+        return;
+    }
+    combineWith(other, &BasicAVLTree::differenceOf, &workers, grainSize);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::setPoolMode(NodePoolMode mode)
+{
+    pool.setMode(mode);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+NodePoolStats BasicAVLTree<Key, Compare, Alloc>::poolStats() const
+{
+    return pool.stats();
+}
+
+// Keys are widened to 64 bits and encoded modulo 2^64, so the deltas of an
+// ascending sequence are small whatever the key's width or signedness.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::serialize(std::ostream &out) const
+{
+    static_assert(std::is_integral<Key>::value, "snapshots need integral keys");
+
+    std::string payload;
+    payload.reserve(size * 2);
+    std::uint64_t previous = 0;
+    bool first = true;
+    visitInorder([&](const Key &key) {
+        std::uint64_t value = static_cast<std::uint64_t>(static_cast<std::int64_t>(key));
+        if (first)
+        {
+            std::int64_t signedValue = static_cast<std::int64_t>(value);
+            avl_detail::putVarint(payload, (value << 1) ^ static_cast<std::uint64_t>(signedValue >> 63));
+            first = false;
+        }
+        else
+        {
+            avl_detail::putVarint(payload, value - previous);
+        }
+        previous = value;
+    });
+
+    std::string header("AVLS");
+    avl_detail::putFixed(header, snapshotVersion, 4);
+    avl_detail::putFixed(header, sizeof(Key), 4);
+    avl_detail::putFixed(header, size, 8);
+    avl_detail::putFixed(header, payload.size(), 8);
+    avl_detail::putFixed(header, crc32c(payload.data(), payload.size(), crc32c(header.data(), header.size())), 4);
+    out.write(header.data(), header.size());
+    out.write(payload.data(), payload.size());
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::deserialize_in(std::istream &in)
+{
+    static_assert(std::is_integral<Key>::value, "snapshots need integral keys");
+
+    unsigned char header[snapshotHeaderSize];
+    in.read(reinterpret_cast<char *>(header), snapshotHeaderSize);
+    if (static_cast<std::size_t>(in.gcount()) != snapshotHeaderSize || std::memcmp(header, "AVLS", 4) != 0)
+    {
+        throw std::runtime_error("AVLTree snapshot: missing header");
+    }
+    if (avl_detail::getFixed(header + 4, 4) != snapshotVersion || avl_detail::getFixed(header + 8, 4) != sizeof(Key))
+    {
+        throw std::runtime_error("AVLTree snapshot: unsupported version or key size");
+    }
+    std::uint64_t count = avl_detail::getFixed(header + 12, 8);
+    std::uint64_t payloadSize = avl_detail::getFixed(header + 20, 8);
+    std::uint32_t checksum = static_cast<std::uint32_t>(avl_detail::getFixed(header + 28, 4));
+    // Every key takes 1 to 10 bytes; divide rather than multiply so that
+    // no count can overflow the check
+    if (count > std::vector<Key>().max_size() || payloadSize < count || (payloadSize + 9) / 10 > count)
+    {
+        throw std::runtime_error("AVLTree snapshot: inconsistent header");
+    }
+
+    // Read in chunks, so a corrupt length runs into the end of the stream
+    // instead of into one huge allocation; the checksum covers the header too
+    const std::size_t chunkSize = 1 << 16;
+    std::string payload;
+    std::uint32_t crc = crc32c(header, snapshotHeaderSize - 4);
+    while (payload.size() < payloadSize)
+    {
+        std::size_t offset = payload.size();
+        std::size_t wanted = static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, payloadSize - offset));
+        payload.resize(offset + wanted);
+        in.read(&payload[offset], wanted);
+        if (static_cast<std::size_t>(in.gcount()) != wanted)
+        {
+            throw std::runtime_error("AVLTree snapshot: truncated payload");
+        }
+        crc = crc32c(payload.data() + offset, wanted, crc);
+    }
+    if (crc != checksum)
+    {
+        throw std::runtime_error("AVLTree snapshot: checksum mismatch");
+    }
+
+    std::vector<Key> keys;
+    keys.reserve(count);
+    const unsigned char *next = reinterpret_cast<const unsigned char *>(payload.data());
+    const unsigned char *end = next + payload.size();
+    std::uint64_t value = 0;
+    for (std::uint64_t i = 0; i < count; i++)
+    {
+        std::uint64_t encoded;
+        if (!avl_detail::getVarint(next, end, encoded))
+        {
+            throw std::runtime_error("AVLTree snapshot: malformed key");
+        }
+        value = (i == 0) ? (encoded >> 1) ^ (~(encoded & 1) + 1) : value + encoded;
+        keys.push_back(static_cast<Key>(value));
+        if (i > 0 && !comp(keys[i - 1], keys[i]))
+        {
+            throw std::runtime_error("AVLTree snapshot: keys out of order");
+        }
+    }
+    if (next != end)
+    {
+        throw std::runtime_error("AVLTree snapshot: trailing bytes");
+    }
+    buildFromSorted(keys.begin(), keys.end());
+}
+
+// Append the top `levels` levels of root's subtree in van Emde Boas order:
+// the upper half of those levels recursively, then each subtree hanging
+// below it, left to right, recursively.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::vebOrder(Node *root, int levels, std::vector<Node *> &order)
+{
+    if (root == nullptr || levels == 0)
+    {
+        return;
+    }
+    if (levels == 1)
+    {
+        order.push_back(root);
+        return;
+    }
+    int top = levels / 2;
+    vebOrder(root, top, order);
+    vebBottoms(root, top, levels - top, order);
+}
+
+// Lay out, left to right, the subtrees rooted depth levels below node.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::vebBottoms(Node *node, int depth, int levels, std::vector<Node *> &order)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+    if (depth == 0)
+    {
+        vebOrder(node, levels, order);
+        return;
+    }
+    vebBottoms(node->left, depth - 1, levels, order);
+    vebBottoms(node->right, depth - 1, levels, order);
+}
+
+// Nodes are copied into a fresh pool's single block. Each copy keeps its old
+// child pointers until every node is placed; the old nodes then forward to
+// their copies through their left links, which is how the copies' links are
+// rewritten. Finally the old pool is released and the fresh one adopted.
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::relayout()
+{
+    mutationsSinceLayout = 0;
+    if (root == nullptr)
+    {
+        return;
+    }
+
+    std::vector<Node *> order;
+    order.reserve(size);
+    vebOrder(root, height(root), order);
+
+    AVLNodePool<Node, NodeAllocator> fresh(pool.allocator(), pool.getMode());
+    Node *block = fresh.allocateBlock(order.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        NodeAllocTraits::construct(fresh.allocator(), block + i, order[i]->data);
+        block[i].left = order[i]->left;
+        block[i].right = order[i]->right;
+        block[i].height = order[i]->height;
+        block[i].subtreeSize = order[i]->subtreeSize;
+    }
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        order[i]->left = block + i;
+    }
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        block[i].left = (block[i].left != nullptr) ? block[i].left->left : nullptr;
+        block[i].right = (block[i].right != nullptr) ? block[i].right->left : nullptr;
+    }
+    root = block;
+
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        NodeAllocTraits::destroy(pool.allocator(), order[i]);
+    }
+    pool.release();
+    pool.adopt(fresh);
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::setRelayoutInterval(std::size_t mutations)
+{
+    relayoutInterval = mutations;
+    mutationsSinceLayout = 0;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicAVLTree<Key, Compare, Alloc>::noteMutations(std::size_t count)
+{
+    if (relayoutInterval == 0 || count == 0)
+    {
+        return;
+    }
+    mutationsSinceLayout += count;
+    if (mutationsSinceLayout >= relayoutInterval)
+    {
+        relayout();
+    }
+}
+
+// destructors
+template <typename Key, typename Compare, typename Alloc>
+BasicAVLTree<Key, Compare, Alloc>::~BasicAVLTree()
+{
+    delete result;
+    clear();
+}
+
+#endif // AVLTREE_H
@@ -0,0 +1,683 @@
+#ifndef BUCKETAVLTREE_H
+#define BUCKETAVLTREE_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "AVLNodePool.h"
+#include "AVLTree.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BUCKET_AVL_X86 1
+#include <immintrin.h>
+#endif
+
+// Instruction set used to search inside a bucket.
+enum class BucketSearchKernel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+namespace bucket_detail
+{
+    // Bucket search kernels: the number of the first capacity keys that are
+    // less than key. Empty slots hold INT_MAX and so are never counted,
+    // which lets every kernel scan the full, fixed-size bucket.
+    typedef unsigned (*CountLessFn)(const int *keys, std::size_t capacity, int key);
+
+    inline unsigned countLessScalar(const int *keys, std::size_t capacity, int key)
+    {
+        unsigned count = 0;
+        for (std::size_t i = 0; i < capacity; i++)
+        {
+            count += keys[i] < key;
+        }
+        return count;
+    }
+
+#ifdef BUCKET_AVL_X86
+    __attribute__((target("sse2,popcnt"))) inline unsigned countLessSse2(const int *keys, std::size_t capacity, int key)
+    {
+        __m128i needle = _mm_set1_epi32(key);
+        unsigned count = 0;
+        for (std::size_t i = 0; i < capacity; i += 4)
+        {
+            __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+            __m128i less = _mm_cmplt_epi32(lanes, needle);
+            count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+        }
+        return count;
+    }
+
+    __attribute__((target("avx2,popcnt"))) inline unsigned countLessAvx2(const int *keys, std::size_t capacity, int key)
+    {
+        __m256i needle = _mm256_set1_epi32(key);
+        unsigned count = 0;
+        for (std::size_t i = 0; i < capacity; i += 8)
+        {
+            __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+            __m256i less = _mm256_cmpgt_epi32(needle, lanes);
+            count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+        }
+        return count;
+    }
+#endif
+
+    inline bool kernelSupported(BucketSearchKernel kernel)
+    {
+        switch (kernel)
+        {
+        case BucketSearchKernel::Scalar:
+            return true;
+#ifdef BUCKET_AVL_X86
+        case BucketSearchKernel::SSE2:
+            return __builtin_cpu_supports("sse2") && __builtin_cpu_supports("popcnt");
+        case BucketSearchKernel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    inline CountLessFn kernelFunction(BucketSearchKernel kernel)
+    {
+        switch (kernel)
+        {
+#ifdef BUCKET_AVL_X86
+        case BucketSearchKernel::SSE2:
+            return &countLessSse2;
+        case BucketSearchKernel::AVX2:
+            return &countLessAvx2;
+#endif
+        default:
+            return &countLessScalar;
+        }
+    }
+
+    // The widest kernel this CPU runs, checked through CPUID.
+    inline BucketSearchKernel bestKernel()
+    {
+        if (kernelSupported(BucketSearchKernel::AVX2))
+        {
+            return BucketSearchKernel::AVX2;
+        }
+        if (kernelSupported(BucketSearchKernel::SSE2))
+        {
+            return BucketSearchKernel::SSE2;
+        }
+        return BucketSearchKernel::Scalar;
+    }
+}
+
+// AVL tree of sorted int buckets (a T-tree). Every node holds up to Capacity
+// keys, and the node's range [keys[0], keys[count - 1]] orders it against
+// its subtrees, so the tree is about log2(Capacity) levels shorter than a
+// one-key-per-node tree. A descent compares against each node's range and
+// finishes with one vectorized count inside the bounding bucket. A full
+// bucket splits its upper half into a new node placed as its in-order
+// successor; a bucket under a quarter full absorbs a neighbouring bucket
+// from its subtree when the two fit in one node.
+template <std::size_t Capacity = 32>
+class BasicBucketAVLTree
+{
+    static_assert(Capacity >= 16 && Capacity <= 64 && Capacity % 8 == 0, "bucket capacity must be a multiple of 8 in [16, 64]");
+
+public: // For testing purposes
+    struct Node
+    {
+        int keys[Capacity]; // ascending; slots from count on hold INT_MAX
+        Node *left;
+        Node *right;
+        int height;
+        int count;
+    };
+
+    static const int minFill = Capacity / 4;
+
+    Node *root = nullptr;
+    std::size_t size = 0;
+    AVLNodePool<Node, std::allocator<Node>> pool;
+    BucketSearchKernel kernel = bucket_detail::bestKernel();
+    bucket_detail::CountLessFn countLessFn = bucket_detail::kernelFunction(kernel);
+
+    Node *createNode();
+    void destroyNode(Node *node);
+
+    static int height(Node *node);
+    static void updateHeight(Node *node);
+    static int getBalanceFactor(Node *node);
+    static Node *rightRotate(Node *y);
+    static Node *leftRotate(Node *x);
+    static Node *rebalance(Node *node);
+    static int minKey(const Node *node) { return node->keys[0]; }
+    static int maxKey(const Node *node) { return node->keys[node->count - 1]; }
+    unsigned countLess(const Node *node, int key) const { return countLessFn(node->keys, Capacity, key); }
+    static void insertAt(Node *node, int position, int key);
+    static void eraseAt(Node *node, int position);
+    Node *insert(Node *node, int key);
+    Node *splitInto(Node *node, int key);
+    static Node *insertLeftmost(Node *root, Node *node);
+    static Node *detachLeftmost(Node *root, Node *&leftmost);
+    static Node *detachRightmost(Node *root, Node *&rightmost);
+    Node *deleteKey(Node *root, int key);
+    Node *refill(Node *node);
+    bool isBalanced(Node *root) const;
+
+public:
+    typedef int key_type;
+
+    BasicBucketAVLTree() {}
+    BasicBucketAVLTree(const BasicBucketAVLTree &) = delete;
+    BasicBucketAVLTree &operator=(const BasicBucketAVLTree &) = delete;
+
+    void insert(int key);
+    void remove(int key);
+    bool contains(int key) const;
+    int successor(int key) const;
+    int predecessor(int key) const;
+    int minimum() const;
+    int maximum() const;
+    std::size_t getsize() const;
+    int height() const;
+    bool isBalanced() const;
+    void clear();
+
+    // Keys in ascending order.
+    template <typename OutputIt>
+    OutputIt inorderTraversal(OutputIt out) const;
+
+    // Pick the bucket search kernel; false, and no change, if this CPU
+    // lacks it. The widest supported kernel is chosen at construction.
+    bool setSearchKernel(BucketSearchKernel newKernel);
+    BucketSearchKernel searchKernel() const;
+};
+
+typedef BasicBucketAVLTree<> BucketAVLTree;
+
+template <std::size_t Capacity>
+const int BasicBucketAVLTree<Capacity>::minFill;
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::createNode()
+{
+    Node *node = pool.allocate();
+    std::fill(node->keys, node->keys + Capacity, INT_MAX);
+    node->left = nullptr;
+    node->right = nullptr;
+    node->height = 1;
+    node->count = 0;
+    return node;
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::destroyNode(Node *node)
+{
+    pool.deallocate(node);
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::height(Node *node)
+{
+    return (node != nullptr) ? node->height : 0;
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::updateHeight(Node *node)
+{
+    node->height = 1 + std::max(height(node->left), height(node->right));
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::getBalanceFactor(Node *node)
+{
+    return (node != nullptr) ? height(node->left) - height(node->right) : 0;
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::rightRotate(Node *y)
+{
+    Node *x = y->left;
+    y->left = x->right;
+    x->right = y;
+    updateHeight(y);
+    updateHeight(x);
+    return x;
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::leftRotate(Node *x)
+{
+    Node *y = x->right;
+    x->right = y->left;
+    y->left = x;
+    updateHeight(x);
+    updateHeight(y);
+    return y;
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::rebalance(Node *node)
+{
+    updateHeight(node);
+    int balance = getBalanceFactor(node);
+    if (balance > 1)
+    {
+        if (getBalanceFactor(node->left) < 0)
+        {
+            node->left = leftRotate(node->left);
+        }
+        return rightRotate(node);
+    }
+    if (balance < -1)
+    {
+        if (getBalanceFactor(node->right) > 0)
+        {
+            node->right = rightRotate(node->right);
+        }
+        return leftRotate(node);
+    }
+    return node;
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::insertAt(Node *node, int position, int key)
+{
+    std::copy_backward(node->keys + position, node->keys + node->count, node->keys + node->count + 1);
+    node->keys[position] = key;
+    node->count++;
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::eraseAt(Node *node, int position)
+{
+    std::copy(node->keys + position + 1, node->keys + node->count, node->keys + position);
+    node->keys[--node->count] = INT_MAX;
+}
+
+// A key below (above) a node's range goes into its left (right) subtree,
+// except that a node without that child takes the key itself while it has
+// room. A key inside the range belongs to the node.
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::insert(Node *node, int key)
+{
+    if (node == nullptr)
+    {
+        node = createNode();
+        insertAt(node, 0, key);
+        size++;
+        return node;
+    }
+
+    if (key < minKey(node))
+    {
+        if (node->left == nullptr && node->count < static_cast<int>(Capacity))
+        {
+            insertAt(node, 0, key);
+            size++;
+            return node;
+        }
+        node->left = insert(node->left, key);
+    }
+    else if (key > maxKey(node))
+    {
+        if (node->right == nullptr && node->count < static_cast<int>(Capacity))
+        {
+            insertAt(node, node->count, key);
+            size++;
+            return node;
+        }
+        node->right = insert(node->right, key);
+    }
+    else
+    {
+        int position = static_cast<int>(countLess(node, key));
+        if (node->keys[position] == key)
+        {
+            return node; // Duplicate keys not allowed
+        }
+        if (node->count < static_cast<int>(Capacity))
+        {
+            insertAt(node, position, key);
+            size++;
+            return node;
+        }
+        node->right = splitInto(node, key);
+    }
+
+    return rebalance(node);
+}
+
+// Move the upper half of the full bucket node into a new node, add key to
+// whichever half it falls in, and hang the new node as the leftmost node of
+// node's right subtree, i.e. as node's in-order successor. Returns the new
+// right subtree.
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::splitInto(Node *node, int key)
+{
+    const int half = static_cast<int>(Capacity) / 2;
+    Node *upper = createNode();
+    std::copy(node->keys + half, node->keys + Capacity, upper->keys);
+    std::fill(node->keys + half, node->keys + Capacity, INT_MAX);
+    upper->count = static_cast<int>(Capacity) - half;
+    node->count = half;
+
+    Node *target = (key < minKey(upper)) ? node : upper;
+    insertAt(target, static_cast<int>(countLess(target, key)), key);
+    size++;
+    return insertLeftmost(node->right, upper);
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::insertLeftmost(Node *root, Node *node)
+{
+    if (root == nullptr)
+    {
+        return node;
+    }
+    root->left = insertLeftmost(root->left, node);
+    return rebalance(root);
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::detachLeftmost(Node *root, Node *&leftmost)
+{
+    if (root->left == nullptr)
+    {
+        leftmost = root;
+        return root->right;
+    }
+    root->left = detachLeftmost(root->left, leftmost);
+    return rebalance(root);
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::detachRightmost(Node *root, Node *&rightmost)
+{
+    if (root->right == nullptr)
+    {
+        rightmost = root;
+        return root->left;
+    }
+    root->right = detachRightmost(root->right, rightmost);
+    return rebalance(root);
+}
+
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::deleteKey(Node *root, int key)
+{
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (key < minKey(root))
+    {
+        root->left = deleteKey(root->left, key);
+    }
+    else if (key > maxKey(root))
+    {
+        root->right = deleteKey(root->right, key);
+    }
+    else
+    {
+        int position = static_cast<int>(countLess(root, key));
+        if (root->keys[position] != key)
+        {
+            return root;
+        }
+        eraseAt(root, position);
+        size--;
+        if (root->count < minFill)
+        {
+            return refill(root);
+        }
+        return root;
+    }
+
+    return rebalance(root);
+}
+
+// node has fallen under minFill keys. Merge the neighbouring bucket from
+// its right (else left) subtree into it when both fit in one node; those
+// keys are adjacent to node's own, so the ranges stay ordered. An empty
+// node with no subtree to draw from is unlinked like an ordinary AVL node.
+template <std::size_t Capacity>
+typename BasicBucketAVLTree<Capacity>::Node *BasicBucketAVLTree<Capacity>::refill(Node *node)
+{
+    if (node->right != nullptr)
+    {
+        Node *next = node->right;
+        while (next->left != nullptr)
+        {
+            next = next->left;
+        }
+        if (node->count + next->count <= static_cast<int>(Capacity))
+        {
+            node->right = detachLeftmost(node->right, next);
+            std::copy(next->keys, next->keys + next->count, node->keys + node->count);
+            node->count += next->count;
+            destroyNode(next);
+        }
+    }
+    else if (node->left != nullptr)
+    {
+        Node *previous = node->left;
+        while (previous->right != nullptr)
+        {
+            previous = previous->right;
+        }
+        if (node->count + previous->count <= static_cast<int>(Capacity))
+        {
+            node->left = detachRightmost(node->left, previous);
+            std::copy_backward(node->keys, node->keys + node->count, node->keys + node->count + previous->count);
+            std::copy(previous->keys, previous->keys + previous->count, node->keys);
+            node->count += previous->count;
+            destroyNode(previous);
+        }
+    }
+
+    if (node->count == 0)
+    {
+        Node *child = (node->left != nullptr) ? node->left : node->right;
+        destroyNode(node);
+        return child;
+    }
+    return rebalance(node);
+}
+
+template <std::size_t Capacity>
+bool BasicBucketAVLTree<Capacity>::isBalanced(Node *root) const
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    int balance = getBalanceFactor(root);
+    return balance >= -1 && balance <= 1 && isBalanced(root->left) && isBalanced(root->right);
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::insert(int key)
+{
+    root = insert(root, key);
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::remove(int key)
+{
+    root = deleteKey(root, key);
+}
+
+template <std::size_t Capacity>
+bool BasicBucketAVLTree<Capacity>::contains(int key) const
+{
+    const Node *node = root;
+    while (node != nullptr)
+    {
+        if (key < minKey(node))
+        {
+            node = node->left;
+        }
+        else if (key > maxKey(node))
+        {
+            node = node->right;
+        }
+        else
+        {
+            return node->keys[countLess(node, key)] == key;
+        }
+    }
+    return false;
+}
+
+// Smallest key greater than key, or -1 like AVLTree::successor().
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::successor(int key) const
+{
+    int candidate = -1;
+    const Node *node = root;
+    while (node != nullptr)
+    {
+        if (key < minKey(node))
+        {
+            candidate = minKey(node);
+            node = node->left;
+        }
+        else if (key >= maxKey(node))
+        {
+            node = node->right;
+        }
+        else
+        {
+            // key + 1 cannot overflow: key is below this node's maximum
+            return node->keys[countLess(node, key + 1)];
+        }
+    }
+    return candidate;
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::predecessor(int key) const
+{
+    int candidate = -1;
+    const Node *node = root;
+    while (node != nullptr)
+    {
+        if (key <= minKey(node))
+        {
+            node = node->left;
+        }
+        else if (key > maxKey(node))
+        {
+            candidate = maxKey(node);
+            node = node->right;
+        }
+        else
+        {
+            return node->keys[countLess(node, key) - 1];
+        }
+    }
+    return candidate;
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::minimum() const
+{
+    const Node *node = root;
+    if (node == nullptr)
+    {
+        return -1;
+    }
+    while (node->left != nullptr)
+    {
+        node = node->left;
+    }
+    return minKey(node);
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::maximum() const
+{
+    const Node *node = root;
+    if (node == nullptr)
+    {
+        return -1;
+    }
+    while (node->right != nullptr)
+    {
+        node = node->right;
+    }
+    return maxKey(node);
+}
+
+template <std::size_t Capacity>
+std::size_t BasicBucketAVLTree<Capacity>::getsize() const
+{
+    return size;
+}
+
+template <std::size_t Capacity>
+int BasicBucketAVLTree<Capacity>::height() const
+{
+    return height(root);
+}
+
+template <std::size_t Capacity>
+bool BasicBucketAVLTree<Capacity>::isBalanced() const
+{
+    return isBalanced(root);
+}
+
+template <std::size_t Capacity>
+void BasicBucketAVLTree<Capacity>::clear()
+{
+    pool.reset();
+    root = nullptr;
+    size = 0;
+}
+
+template <std::size_t Capacity>
+template <typename OutputIt>
+OutputIt BasicBucketAVLTree<Capacity>::inorderTraversal(OutputIt out) const
+{
+    const Node *pending[AVLTree::maxHeight];
+    int depth = 0;
+    const Node *node = root;
+    while (node != nullptr || depth > 0)
+    {
+        for (; node != nullptr; node = node->left)
+        {
+            pending[depth++] = node;
+        }
+        node = pending[--depth];
+        out = std::copy(node->keys, node->keys + node->count, out);
+        node = node->right;
+    }
+    return out;
+}
+
+template <std::size_t Capacity>
+bool BasicBucketAVLTree<Capacity>::setSearchKernel(BucketSearchKernel newKernel)
+{
+    if (!bucket_detail::kernelSupported(newKernel))
+    {
+        return false;
+    }
+    kernel = newKernel;
+    countLessFn = bucket_detail::kernelFunction(newKernel);
+    return true;
+}
+
+template <std::size_t Capacity>
+BucketSearchKernel BasicBucketAVLTree<Capacity>::searchKernel() const
+{
+    return kernel;
+}
+
+#endif // BUCKETAVLTREE_H
@@ -0,0 +1,713 @@
+#ifndef COMPACTAVLTREE_H
+#define COMPACTAVLTREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+#include "AVLTree.h"
+
+// AVL tree storing its nodes in one contiguous array, linked by 32-bit
+// indices instead of pointers. Each link keeps a 28-bit child index and one
+// nibble of the node's height, so an int node is 12 bytes instead of 24 and
+// the tree holds up to 2^28 - 1 keys. Slot 0 is a sentinel standing in for
+// nullptr; its height is 0. The public API matches BasicAVLTree.
+template <typename Key, typename Compare = std::less<Key>>
+class BasicCompactAVLTree
+{
+public: // For testing purposes
+    typedef std::uint32_t Index;
+
+    static const Index nil = 0;
+    static const Index indexMask = 0x0FFFFFFF;
+    static const Index maxNodes = indexMask;
+
+    struct Node
+    {
+        Key data;
+        Index leftLink;  // child index | low height nibble << 28
+        Index rightLink; // child index | high height nibble << 28
+    };
+
+    std::vector<Node> nodes;
+    std::size_t size = 0;
+    Index root = nil;
+    Index freeList = nil; // released slots, chained through leftLink
+    Compare comp;
+
+    Index left(Index node) const { return nodes[node].leftLink & indexMask; }
+    Index right(Index node) const { return nodes[node].rightLink & indexMask; }
+    void setLeft(Index node, Index child) { nodes[node].leftLink = (nodes[node].leftLink & ~indexMask) | child; }
+    void setRight(Index node, Index child) { nodes[node].rightLink = (nodes[node].rightLink & ~indexMask) | child; }
+    void setHeight(Index node, int height);
+    void updateHeight(Index node);
+
+    Index createNode(const Key &data);
+    void destroyNode(Index node);
+    bool equal(const Key &a, const Key &b) const { return !comp(a, b) && !comp(b, a); }
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+
+    int height(Index node) const;
+    int getBalanceFactor(Index node) const;
+    Index rightRotate(Index y);
+    Index leftRotate(Index x);
+    Index rebalance(Index node);
+    Index insert(Index node, const Key &data);
+    Index deleteNode(Index root, const Key &key);
+    void inorderTraversal(Index root);
+    void preorderTraversal(Index root);
+    void postorderTraversal(Index root);
+    bool depthFirstSearch(Index root, const Key &key) const;
+    Index findMin(Index root) const;
+    Index findMax(Index root) const;
+    int countNodes(Index root) const;
+    bool isBalanced(Index root) const;
+    Index lowerBound(Index root, const Key &key) const;
+    Index upperBound(Index root, const Key &key) const;
+    Index findPredecessor(Index root, const Key &key) const;
+    void rangeSearch(Index root, const Key &k1, const Key &k2);
+
+public:
+    typedef Key key_type;
+    typedef Compare key_compare;
+
+    std::vector<Key> *result = new std::vector<Key>();
+    BasicCompactAVLTree();
+    explicit BasicCompactAVLTree(const Compare &comp);
+    BasicCompactAVLTree(const BasicCompactAVLTree &) = delete;
+    BasicCompactAVLTree &operator=(const BasicCompactAVLTree &) = delete;
+    ~BasicCompactAVLTree();
+    void insert(const Key &data);
+    void remove(const Key &data);
+    Key getRoot();
+    std::size_t getsize();
+    void inorderTraversal();
+    void preorderTraversal();
+    void postorderTraversal();
+    void levelOrderTraversal();
+    bool depthFirstSearch(const Key &key);
+    bool breadthFirstSearch(const Key &key);
+    int height();
+    Key minimum();
+    Key maximum();
+    void clear();
+    int count();
+    bool isBalanced();
+    Key successor(const Key &key);
+    Key predecessor(const Key &key);
+    void rangeSearch(const Key &k1, const Key &k2);
+    void updateKey(const Key &oldKey, const Key &newKey);
+
+    bool contains(const Key &key) const;
+    Key lower_bound(const Key &key) const;
+    Key upper_bound(const Key &key) const;
+    void reserve(std::size_t count);
+};
+
+typedef BasicCompactAVLTree<int> CompactAVLTree;
+
+static_assert(sizeof(CompactAVLTree::Node) == 12, "compact int node should be 12 bytes");
+
+template <typename Key, typename Compare>
+const typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::nil;
+
+template <typename Key, typename Compare>
+const typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::indexMask;
+
+template <typename Key, typename Compare>
+const typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::maxNodes;
+
+template <typename Key, typename Compare>
+BasicCompactAVLTree<Key, Compare>::BasicCompactAVLTree()
+{
+    nodes.push_back(Node{Key(), nil, nil});
+}
+
+template <typename Key, typename Compare>
+BasicCompactAVLTree<Key, Compare>::BasicCompactAVLTree(const Compare &comp) : comp(comp)
+{
+    nodes.push_back(Node{Key(), nil, nil});
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::setHeight(Index node, int height)
+{
+    Index h = static_cast<Index>(height);
+    nodes[node].leftLink = (nodes[node].leftLink & indexMask) | ((h & 0xF) << 28);
+    nodes[node].rightLink = (nodes[node].rightLink & indexMask) | ((h >> 4) << 28);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::updateHeight(Index node)
+{
+    setHeight(node, 1 + std::max(height(left(node)), height(right(node))));
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::createNode(const Key &data)
+{
+    Index node;
+    if (freeList != nil)
+    {
+        node = freeList;
+        freeList = left(node);
+        nodes[node].data = data;
+    }
+    else
+    {
+        if (nodes.size() > maxNodes)
+        {
+            throw std::length_error("CompactAVLTree: index space exhausted");
+        }
+        node = static_cast<Index>(nodes.size());
+        nodes.push_back(Node{data, nil, nil});
+    }
+    nodes[node].leftLink = nil;
+    nodes[node].rightLink = nil;
+    setHeight(node, 1);
+    return node;
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::destroyNode(Index node)
+{
+    nodes[node].data = Key();
+    nodes[node].leftLink = freeList;
+    nodes[node].rightLink = nil;
+    freeList = node;
+}
+
+template <typename Key, typename Compare>
+int BasicCompactAVLTree<Key, Compare>::height(Index node) const
+{
+    return static_cast<int>((nodes[node].leftLink >> 28) | ((nodes[node].rightLink >> 28) << 4));
+}
+
+template <typename Key, typename Compare>
+int BasicCompactAVLTree<Key, Compare>::getBalanceFactor(Index node) const
+{
+    if (node == nil)
+    {
+        return 0;
+    }
+    return height(left(node)) - height(right(node));
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::rightRotate(Index y)
+{
+    Index x = left(y);
+    Index T2 = right(x);
+
+    // Perform rotation
+    setRight(x, y);
+    setLeft(y, T2);
+
+    // Update heights
+    updateHeight(y);
+    updateHeight(x);
+
+    return x;
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::leftRotate(Index x)
+{
+    Index y = right(x);
+    Index T2 = left(y);
+
+    // Perform rotation
+    setLeft(y, x);
+    setRight(x, T2);
+
+    // Update heights
+    updateHeight(x);
+    updateHeight(y);
+
+    return y;
+}
+
+// Restore the AVL property at node after one of its subtrees changed height by one.
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::rebalance(Index node)
+{
+    updateHeight(node);
+
+    int balance = getBalanceFactor(node);
+
+    if (balance > 1)
+    {
+        if (getBalanceFactor(left(node)) < 0)
+        {
+            setLeft(node, leftRotate(left(node)));
+        }
+        return rightRotate(node);
+    }
+
+    if (balance < -1)
+    {
+        if (getBalanceFactor(right(node)) > 0)
+        {
+            setRight(node, rightRotate(right(node)));
+        }
+        return leftRotate(node);
+    }
+
+    return node;
+}
+
+// Only indices are held across the recursive calls: createNode may grow the
+// node array and invalidate references into it.
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::insert(Index node, const Key &data)
+{
+    if (node == nil)
+    {
+        size++;
+        return createNode(data);
+    }
+
+    if (comp(data, nodes[node].data))
+    {
+        Index child = insert(left(node), data);
+        setLeft(node, child);
+    }
+    else if (comp(nodes[node].data, data))
+    {
+        Index child = insert(right(node), data);
+        setRight(node, child);
+    }
+    else
+    {
+        return node; // Duplicate keys not allowed
+    }
+
+    return rebalance(node);
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::deleteNode(Index root, const Key &key)
+{
+    if (root == nil)
+    {
+        return root;
+    }
+
+    if (comp(key, nodes[root].data))
+    {
+        setLeft(root, deleteNode(left(root), key));
+    }
+    else if (comp(nodes[root].data, key))
+    {
+        setRight(root, deleteNode(right(root), key));
+    }
+    else if (left(root) == nil || right(root) == nil)
+    {
+        // Zero or one child: splice the node out
+        Index child = (left(root) != nil) ? left(root) : right(root);
+        destroyNode(root);
+        size--;
+        return child;
+    }
+    else
+    {
+        // Two children: take over the in-order successor's key and delete it from the right subtree
+        nodes[root].data = nodes[findMin(right(root))].data;
+        setRight(root, deleteNode(right(root), nodes[root].data));
+    }
+
+    return rebalance(root);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::inorderTraversal(Index root)
+{
+    if (root != nil)
+    {
+        inorderTraversal(left(root));
+        result->push_back(nodes[root].data);
+        inorderTraversal(right(root));
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::preorderTraversal(Index root)
+{
+    if (root != nil)
+    {
+        result->push_back(nodes[root].data);
+        preorderTraversal(left(root));
+        preorderTraversal(right(root));
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::postorderTraversal(Index root)
+{
+    if (root != nil)
+    {
+        postorderTraversal(left(root));
+        postorderTraversal(right(root));
+        result->push_back(nodes[root].data);
+    }
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::depthFirstSearch(Index root, const Key &key) const
+{
+    if (root == nil)
+    {
+        return false;
+    }
+    if (equal(nodes[root].data, key))
+    {
+        return true;
+    }
+    return depthFirstSearch(left(root), key) || depthFirstSearch(right(root), key);
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::findMin(Index root) const
+{
+    if (root == nil)
+    {
+        return nil;
+    }
+    while (left(root) != nil)
+    {
+        root = left(root);
+    }
+    return root;
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::findMax(Index root) const
+{
+    if (root == nil)
+    {
+        return nil;
+    }
+    while (right(root) != nil)
+    {
+        root = right(root);
+    }
+    return root;
+}
+
+template <typename Key, typename Compare>
+int BasicCompactAVLTree<Key, Compare>::countNodes(Index root) const
+{
+    if (root == nil)
+    {
+        return 0;
+    }
+    return 1 + countNodes(left(root)) + countNodes(right(root));
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::isBalanced(Index root) const
+{
+    if (root == nil)
+    {
+        return true;
+    }
+    int balance = getBalanceFactor(root);
+    return (balance >= -1 && balance <= 1) && isBalanced(left(root)) && isBalanced(right(root));
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::lowerBound(Index root, const Key &key) const
+{
+    Index bound = nil;
+    while (root != nil)
+    {
+        if (comp(nodes[root].data, key))
+        {
+            root = right(root);
+        }
+        else
+        {
+            bound = root;
+            root = left(root);
+        }
+    }
+    return bound;
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::upperBound(Index root, const Key &key) const
+{
+    Index bound = nil;
+    while (root != nil)
+    {
+        if (comp(key, nodes[root].data))
+        {
+            bound = root;
+            root = left(root);
+        }
+        else
+        {
+            root = right(root);
+        }
+    }
+    return bound;
+}
+
+template <typename Key, typename Compare>
+typename BasicCompactAVLTree<Key, Compare>::Index BasicCompactAVLTree<Key, Compare>::findPredecessor(Index root, const Key &key) const
+{
+    Index predecessor = nil;
+    while (root != nil)
+    {
+        if (comp(nodes[root].data, key))
+        {
+            predecessor = root;
+            root = right(root);
+        }
+        else
+        {
+            root = left(root);
+        }
+    }
+    return predecessor;
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::rangeSearch(Index root, const Key &k1, const Key &k2)
+{
+    if (root == nil)
+    {
+        return;
+    }
+    if (comp(k1, nodes[root].data))
+    {
+        rangeSearch(left(root), k1, k2);
+    }
+    if (!comp(nodes[root].data, k1) && !comp(k2, nodes[root].data))
+    {
+        result->push_back(nodes[root].data);
+    }
+    if (comp(nodes[root].data, k2))
+    {
+        rangeSearch(right(root), k1, k2);
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::insert(const Key &data)
+{
+    root = insert(root, data);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::remove(const Key &data)
+{
+    root = deleteNode(root, data);
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::getRoot()
+{
+    return nodes[root].data;
+}
+
+template <typename Key, typename Compare>
+std::size_t BasicCompactAVLTree<Key, Compare>::getsize()
+{
+    return size;
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::inorderTraversal()
+{
+    inorderTraversal(root);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::preorderTraversal()
+{
+    preorderTraversal(root);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::postorderTraversal()
+{
+    postorderTraversal(root);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::levelOrderTraversal()
+{
+    if (root == nil)
+    {
+        return;
+    }
+
+    std::queue<Index> q;
+    q.push(root);
+
+    while (!q.empty())
+    {
+        Index temp = q.front();
+        q.pop();
+        result->push_back(nodes[temp].data);
+
+        if (left(temp) != nil)
+        {
+            q.push(left(temp));
+        }
+        if (right(temp) != nil)
+        {
+            q.push(right(temp));
+        }
+    }
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::depthFirstSearch(const Key &key)
+{
+    return depthFirstSearch(root, key);
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::breadthFirstSearch(const Key &key)
+{
+    if (root == nil)
+    {
+        return false;
+    }
+
+    std::queue<Index> q;
+    q.push(root);
+
+    while (!q.empty())
+    {
+        Index current = q.front();
+        q.pop();
+
+        if (equal(nodes[current].data, key))
+        {
+            return true;
+        }
+        if (left(current) != nil)
+        {
+            q.push(left(current));
+        }
+        if (right(current) != nil)
+        {
+            q.push(right(current));
+        }
+    }
+
+    return false;
+}
+
+template <typename Key, typename Compare>
+int BasicCompactAVLTree<Key, Compare>::height()
+{
+    return height(root);
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::minimum()
+{
+    Index minNode = findMin(root);
+    return (minNode != nil) ? nodes[minNode].data : notFound();
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::maximum()
+{
+    Index maxNode = findMax(root);
+    return (maxNode != nil) ? nodes[maxNode].data : notFound();
+}
+
+// Dropping every node is a single resize of the node array.
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::clear()
+{
+    nodes.resize(1);
+    root = nil;
+    freeList = nil;
+    size = 0;
+}
+
+template <typename Key, typename Compare>
+int BasicCompactAVLTree<Key, Compare>::count()
+{
+    return countNodes(root);
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::isBalanced()
+{
+    return isBalanced(root);
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::successor(const Key &key)
+{
+    Index successorNode = upperBound(root, key);
+    return (successorNode != nil) ? nodes[successorNode].data : notFound();
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::predecessor(const Key &key)
+{
+    Index predecessorNode = findPredecessor(root, key);
+    return (predecessorNode != nil) ? nodes[predecessorNode].data : notFound();
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::rangeSearch(const Key &k1, const Key &k2)
+{
+    rangeSearch(root, k1, k2);
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::updateKey(const Key &oldKey, const Key &newKey)
+{
+    if (contains(oldKey))
+    {
+        remove(oldKey);
+        insert(newKey);
+    }
+}
+
+template <typename Key, typename Compare>
+bool BasicCompactAVLTree<Key, Compare>::contains(const Key &key) const
+{
+    Index candidate = lowerBound(root, key);
+    return candidate != nil && !comp(key, nodes[candidate].data);
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::lower_bound(const Key &key) const
+{
+    Index boundNode = lowerBound(root, key);
+    return (boundNode != nil) ? nodes[boundNode].data : notFound();
+}
+
+template <typename Key, typename Compare>
+Key BasicCompactAVLTree<Key, Compare>::upper_bound(const Key &key) const
+{
+    Index boundNode = upperBound(root, key);
+    return (boundNode != nil) ? nodes[boundNode].data : notFound();
+}
+
+template <typename Key, typename Compare>
+void BasicCompactAVLTree<Key, Compare>::reserve(std::size_t count)
+{
+    nodes.reserve(count + 1);
+}
+
+// destructors
+template <typename Key, typename Compare>
+BasicCompactAVLTree<Key, Compare>::~BasicCompactAVLTree()
+{
+    delete result;
+}
+
+#endif // COMPACTAVLTREE_H
@@ -0,0 +1,1004 @@
+#ifndef CONCURRENTAVLTREE_H
+#define CONCURRENTAVLTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "AVLTree.h"
+
+// Concurrent AVL set after Bronson, Casper, Chafi and Olukotun, "A Practical
+// Concurrent Binary Search Tree" (PPoPP 2010). Readers take no locks. Each
+// node carries a version that a rotation bumps when it moves keys out of
+// the node's subtree; a reader descends hand over hand, reading a child
+// pointer and then checking that the parent's version has not moved, and
+// retries from the deepest node that is still valid if it has. Writers
+// lock only the nodes they change: an insert locks the node it hangs the
+// new leaf from, a remove of a node with two children just marks it absent
+// (it stays as a routing node), and rebalancing locks a parent, a node and
+// the child being rotated up. Balance is relaxed while writers race and
+// restored by the repair walk each writer finishes with.
+//
+// Unlinked nodes may still be under a reader, so they are freed by epochs:
+// every operation publishes the global epoch it entered at, an unlinked
+// node goes on its thread's retired list stamped with the epoch of the
+// unlink, and the epoch advances only once every thread inside the tree has
+// entered at the current one. A node retired at epoch e is therefore
+// unreachable to everyone by epoch e + 2, and is freed then.
+template <typename Key, typename Compare = std::less<Key>>
+class BasicConcurrentAVLTree
+{
+public: // For testing purposes
+    struct Node
+    {
+        const Key key;
+        std::atomic<int> height;
+        std::atomic<bool> present; // false for routing nodes
+        std::atomic<Node *> parent;
+        std::atomic<std::uint64_t> version;
+        std::atomic<Node *> left;
+        std::atomic<Node *> right;
+        std::mutex lock;
+
+        Node(const Key &key, int height, bool present, Node *parent)
+            : key(key), height(height), present(present), parent(parent), version(0), left(nullptr), right(nullptr)
+        {
+        }
+
+        // dir < 0 is the left child, dir > 0 the right.
+        Node *child(int dir) const { return dir < 0 ? left.load() : right.load(); }
+        void setChild(int dir, Node *node) { (dir < 0 ? left : right).store(node); }
+    };
+
+    // Version bits: unlinked is a terminal value; shrinking is set while a
+    // rotation is moving keys out of the node; each rotation then adds one step.
+    static const std::uint64_t unlinked = 1;
+    static const std::uint64_t shrinking = 2;
+    static const std::uint64_t versionStep = 4;
+
+    // nodeCondition results other than a new height.
+    static const int unlinkRequired = -1;
+    static const int rebalanceRequired = -2;
+    static const int nothingRequired = -3;
+
+    // Retry: a node on the way changed under the caller, try again from
+    // the deepest node still valid. Hit: found (reads) or changed (writes).
+    enum Outcome
+    {
+        Retry,
+        Miss,
+        Hit
+    };
+
+    struct Retired
+    {
+        Node *node;
+        std::uint64_t epoch;
+    };
+
+    // One per thread that has used the tree, kept until the tree goes.
+    // Only the owner adds to retired; the lock lets a thread that advances
+    // the epoch also free what exited threads left behind.
+    struct ThreadRecord
+    {
+        std::atomic<std::uint64_t> epoch; // 0 while outside the tree
+        const std::thread::id owner;
+        ThreadRecord *next;
+        std::mutex lock;
+        std::vector<Retired> retired;
+        std::atomic<std::size_t> pending; // retired.size(), read without the lock
+
+        explicit ThreadRecord(std::thread::id owner) : epoch(0), owner(owner), next(nullptr), pending(0) {}
+    };
+
+    // Holds the calling thread inside the tree for one operation.
+    class EpochGuard
+    {
+    public:
+        explicit EpochGuard(const BasicConcurrentAVLTree &tree) : tree(tree), record(tree.enter()) {}
+        ~EpochGuard() { tree.leave(record); }
+        EpochGuard(const EpochGuard &) = delete;
+        EpochGuard &operator=(const EpochGuard &) = delete;
+
+    private:
+        const BasicConcurrentAVLTree &tree;
+        ThreadRecord *record;
+    };
+
+    // A thread tries to advance the epoch once this many of its unlinked
+    // nodes are waiting.
+    static const std::size_t retireBatch = 64;
+
+    Node *rootHolder; // the root is rootHolder->right
+    std::atomic<std::size_t> size;
+    Compare comp;
+    const std::uint64_t id; // tells trees apart in the per-thread record cache
+    mutable std::atomic<std::uint64_t> epoch;
+    mutable std::atomic<ThreadRecord *> records;
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+    static int height(const Node *node) { return node ? node->height.load() : 0; }
+    static bool isShrinkingOrUnlinked(std::uint64_t version) { return (version & (shrinking | unlinked)) != 0; }
+    static void waitUntilNotChanging(Node *node);
+
+    int compare(const Key &a, const Key &b) const { return comp(a, b) ? -1 : (comp(b, a) ? 1 : 0); }
+
+    Outcome attemptContains(const Key &key, Node *node, int dir, std::uint64_t version) const;
+    Outcome attemptBound(Node *node, std::uint64_t version, const Key *key, int dir, Key &found) const;
+    Outcome descendBound(Node *node, std::uint64_t version, int side, const Key *key, int dir, Key &found) const;
+    Key bound(const Key *key, int dir) const;
+
+    bool update(const Key &key, bool present);
+    Outcome attemptUpdate(const Key &key, bool present, Node *parent, Node *node, std::uint64_t version);
+    Outcome attemptNodeUpdate(bool present, Node *parent, Node *node);
+    bool attemptUnlink(Node *parent, Node *node);
+
+    // Repairs. Each expects the nodes it changes to be locked by the caller,
+    // except fixHeightAndRebalance, which takes the locks it needs.
+    static int nodeCondition(Node *node);
+    static Node *fixHeight(Node *node);
+    void fixHeightAndRebalance(Node *node);
+    Node *rebalance(Node *parent, Node *node);
+    Node *rebalanceAway(Node *parent, Node *node, Node *heavyChild, int lightHeight, int heavy);
+    static Node *rotateSingle(Node *parent, Node *node, Node *heavyChild, int lightHeight, int outerHeight,
+                              Node *inner, int innerHeight, int heavy);
+    static Node *rotateDouble(Node *parent, Node *node, Node *heavyChild, int lightHeight, int outerHeight,
+                              Node *inner, int innerOuterHeight, int heavy);
+
+    void destroy(Node *node);
+
+    // Reclamation.
+    static std::uint64_t nextId();
+    ThreadRecord *threadRecord() const;
+    ThreadRecord *enter() const;
+    void leave(ThreadRecord *record) const;
+    void retire(Node *node);
+    void reclaimRetired(ThreadRecord *self) const;
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    explicit BasicConcurrentAVLTree(const Compare &comp = Compare());
+    BasicConcurrentAVLTree(const BasicConcurrentAVLTree &) = delete;
+    BasicConcurrentAVLTree &operator=(const BasicConcurrentAVLTree &) = delete;
+    ~BasicConcurrentAVLTree();
+
+    // Safe to call from any number of threads at once. insert and remove
+    // return whether the set changed.
+    bool insert(const Key &key) { return update(key, true); }
+    bool remove(const Key &key) { return update(key, false); }
+    bool contains(const Key &key) const;
+    Key successor(const Key &key) const { return bound(&key, 1); }
+    Key predecessor(const Key &key) const { return bound(&key, -1); }
+    Key minimum() const { return bound(nullptr, 1); }
+    Key maximum() const { return bound(nullptr, -1); }
+    std::size_t getsize() const { return size.load(); }
+};
+
+typedef BasicConcurrentAVLTree<int> ConcurrentAVLTree;
+
+template <typename Key, typename Compare>
+const std::uint64_t BasicConcurrentAVLTree<Key, Compare>::unlinked;
+
+template <typename Key, typename Compare>
+const std::uint64_t BasicConcurrentAVLTree<Key, Compare>::shrinking;
+
+template <typename Key, typename Compare>
+const std::uint64_t BasicConcurrentAVLTree<Key, Compare>::versionStep;
+
+template <typename Key, typename Compare>
+const int BasicConcurrentAVLTree<Key, Compare>::unlinkRequired;
+
+template <typename Key, typename Compare>
+const int BasicConcurrentAVLTree<Key, Compare>::rebalanceRequired;
+
+template <typename Key, typename Compare>
+const int BasicConcurrentAVLTree<Key, Compare>::nothingRequired;
+
+template <typename Key, typename Compare>
+const std::size_t BasicConcurrentAVLTree<Key, Compare>::retireBatch;
+
+template <typename Key, typename Compare>
+BasicConcurrentAVLTree<Key, Compare>::BasicConcurrentAVLTree(const Compare &comp)
+    : rootHolder(new Node(Key(), 0, false, nullptr)), size(0), comp(comp), id(nextId()), epoch(1), records(nullptr)
+{
+}
+
+template <typename Key, typename Compare>
+BasicConcurrentAVLTree<Key, Compare>::~BasicConcurrentAVLTree()
+{
+    destroy(rootHolder);
+    ThreadRecord *record = records.load();
+    while (record != nullptr)
+    {
+        for (std::size_t i = 0; i < record->retired.size(); i++)
+        {
+            delete record->retired[i].node;
+        }
+        ThreadRecord *next = record->next;
+        delete record;
+        record = next;
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::destroy(Node *node)
+{
+    std::vector<Node *> pending(1, node);
+    while (!pending.empty())
+    {
+        node = pending.back();
+        pending.pop_back();
+        if (node->left.load() != nullptr)
+        {
+            pending.push_back(node->left.load());
+        }
+        if (node->right.load() != nullptr)
+        {
+            pending.push_back(node->right.load());
+        }
+        delete node;
+    }
+}
+
+template <typename Key, typename Compare>
+std::uint64_t BasicConcurrentAVLTree<Key, Compare>::nextId()
+{
+    static std::atomic<std::uint64_t> next(1);
+    return next.fetch_add(1);
+}
+
+// The calling thread's record, created on its first use of the tree. The
+// last tree a thread used is cached, so the list is searched only when a
+// thread moves between trees.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::ThreadRecord *BasicConcurrentAVLTree<Key, Compare>::threadRecord() const
+{
+    static thread_local std::uint64_t cachedTree = 0;
+    static thread_local ThreadRecord *cachedRecord = nullptr;
+    if (cachedTree == id)
+    {
+        return cachedRecord;
+    }
+    std::thread::id self = std::this_thread::get_id();
+    ThreadRecord *record = records.load();
+    while (record != nullptr && record->owner != self)
+    {
+        record = record->next;
+    }
+    if (record == nullptr)
+    {
+        record = new ThreadRecord(self);
+        ThreadRecord *head = records.load();
+        do
+        {
+            record->next = head;
+        } while (!records.compare_exchange_weak(head, record));
+    }
+    cachedTree = id;
+    cachedRecord = record;
+    return record;
+}
+
+// Publish the epoch the thread enters at, and make sure it is still the
+// current one, so an advance cannot have missed the thread.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::ThreadRecord *BasicConcurrentAVLTree<Key, Compare>::enter() const
+{
+    ThreadRecord *record = threadRecord();
+    std::uint64_t current;
+    do
+    {
+        current = epoch.load();
+        record->epoch.store(current);
+    } while (epoch.load() != current);
+    return record;
+}
+
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::leave(ThreadRecord *record) const
+{
+    record->epoch.store(0);
+    if (record->pending.load() >= retireBatch)
+    {
+        reclaimRetired(record);
+    }
+}
+
+// node was just unlinked, so it is stamped with an epoch no earlier than
+// the one any thread that can still reach it entered at.
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::retire(Node *node)
+{
+    ThreadRecord *record = threadRecord();
+    Retired retired = {node, epoch.load()};
+    std::lock_guard<std::mutex> guard(record->lock);
+    record->retired.push_back(retired);
+    record->pending.store(record->retired.size());
+}
+
+// Advance the epoch if every thread inside the tree entered at the current
+// one, then free every retired node two epochs old: the caller's, and those
+// of any other record not busy retiring. Lists are in epoch order.
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::reclaimRetired(ThreadRecord *self) const
+{
+    std::uint64_t current = epoch.load();
+    bool advance = true;
+    for (ThreadRecord *record = records.load(); record != nullptr && advance; record = record->next)
+    {
+        std::uint64_t entered = record->epoch.load();
+        advance = (entered == 0 || entered == current);
+    }
+    if (advance)
+    {
+        epoch.compare_exchange_strong(current, current + 1);
+    }
+
+    std::uint64_t safe = epoch.load();
+    for (ThreadRecord *record = records.load(); record != nullptr; record = record->next)
+    {
+        std::unique_lock<std::mutex> guard(record->lock, std::defer_lock);
+        if (record == self)
+        {
+            guard.lock();
+        }
+        else if (!guard.try_lock())
+        {
+            continue;
+        }
+        std::size_t freed = 0;
+        while (freed < record->retired.size() && record->retired[freed].epoch + 2 <= safe)
+        {
+            delete record->retired[freed].node;
+            freed++;
+        }
+        record->retired.erase(record->retired.begin(), record->retired.begin() + freed);
+        record->pending.store(record->retired.size());
+    }
+}
+
+// A rotation holds the node's lock for as long as the shrinking bit is set.
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::waitUntilNotChanging(Node *node)
+{
+    std::uint64_t version = node->version.load();
+    if ((version & shrinking) == 0)
+    {
+        return;
+    }
+    for (int spin = 0; spin < 100; spin++)
+    {
+        if (node->version.load() != version)
+        {
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> guard(node->lock);
+}
+
+template <typename Key, typename Compare>
+bool BasicConcurrentAVLTree<Key, Compare>::contains(const Key &key) const
+{
+    EpochGuard inside(*this);
+    for (;;)
+    {
+        Node *node = rootHolder->right.load();
+        if (node == nullptr)
+        {
+            return false;
+        }
+        int dir = compare(key, node->key);
+        if (dir == 0)
+        {
+            return node->present.load();
+        }
+        std::uint64_t version = node->version.load();
+        if (isShrinkingOrUnlinked(version))
+        {
+            waitUntilNotChanging(node);
+            continue;
+        }
+        if (node != rootHolder->right.load())
+        {
+            continue;
+        }
+        Outcome outcome = attemptContains(key, node, dir, version);
+        if (outcome != Retry)
+        {
+            return outcome == Hit;
+        }
+    }
+}
+
+// key is somewhere below node in direction dir, as of version. A node's
+// presence flag is the linearization point: an unlinked node reads absent.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Outcome
+BasicConcurrentAVLTree<Key, Compare>::attemptContains(const Key &key, Node *node, int dir, std::uint64_t version) const
+{
+    for (;;)
+    {
+        Node *child = node->child(dir);
+        if (node->version.load() != version)
+        {
+            return Retry;
+        }
+        if (child == nullptr)
+        {
+            return Miss;
+        }
+        int childDir = compare(key, child->key);
+        if (childDir == 0)
+        {
+            return child->present.load() ? Hit : Miss;
+        }
+        std::uint64_t childVersion = child->version.load();
+        if (isShrinkingOrUnlinked(childVersion))
+        {
+            waitUntilNotChanging(child);
+            continue;
+        }
+        if (child != node->child(dir) || node->version.load() != version)
+        {
+            continue;
+        }
+        Outcome outcome = attemptContains(key, child, childDir, childVersion);
+        if (outcome != Retry)
+        {
+            return outcome;
+        }
+    }
+}
+
+// The first present key beyond key in direction dir (dir > 0: the smallest
+// greater key; dir < 0: the largest smaller one) within node's subtree;
+// with key == nullptr, the first in that direction overall. Routing nodes
+// do not count, so when node itself would be the answer but is absent the
+// search carries on into its far subtree.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Outcome
+BasicConcurrentAVLTree<Key, Compare>::attemptBound(Node *node, std::uint64_t version, const Key *key, int dir, Key &found) const
+{
+    if (key != nullptr && compare(node->key, *key) != dir)
+    {
+        return descendBound(node, version, dir, key, dir, found);
+    }
+    Outcome outcome = descendBound(node, version, -dir, key, dir, found);
+    if (outcome != Miss)
+    {
+        return outcome;
+    }
+    bool present = node->present.load();
+    if (node->version.load() != version)
+    {
+        return Retry;
+    }
+    if (present)
+    {
+        found = node->key;
+        return Hit;
+    }
+    return descendBound(node, version, dir, nullptr, dir, found);
+}
+
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Outcome
+BasicConcurrentAVLTree<Key, Compare>::descendBound(Node *node, std::uint64_t version, int side, const Key *key, int dir, Key &found) const
+{
+    for (;;)
+    {
+        Node *child = node->child(side);
+        if (node->version.load() != version)
+        {
+            return Retry;
+        }
+        if (child == nullptr)
+        {
+            return Miss;
+        }
+        std::uint64_t childVersion = child->version.load();
+        if (isShrinkingOrUnlinked(childVersion))
+        {
+            waitUntilNotChanging(child);
+            continue;
+        }
+        if (child != node->child(side) || node->version.load() != version)
+        {
+            continue;
+        }
+        Outcome outcome = attemptBound(child, childVersion, key, dir, found);
+        if (outcome != Retry)
+        {
+            return outcome;
+        }
+    }
+}
+
+// The root holder is never rotated, so its version never changes and a
+// search from it only ever retries below it.
+template <typename Key, typename Compare>
+Key BasicConcurrentAVLTree<Key, Compare>::bound(const Key *key, int dir) const
+{
+    EpochGuard inside(*this);
+    Key found;
+    Outcome outcome;
+    do
+    {
+        outcome = descendBound(rootHolder, 0, 1, key, dir, found);
+    } while (outcome == Retry);
+    return (outcome == Hit) ? found : notFound();
+}
+
+template <typename Key, typename Compare>
+bool BasicConcurrentAVLTree<Key, Compare>::update(const Key &key, bool present)
+{
+    EpochGuard inside(*this);
+    for (;;)
+    {
+        Node *node = rootHolder->right.load();
+        if (node == nullptr)
+        {
+            if (!present)
+            {
+                return false;
+            }
+            std::lock_guard<std::mutex> guard(rootHolder->lock);
+            if (rootHolder->right.load() == nullptr)
+            {
+                rootHolder->right.store(new Node(key, 1, true, rootHolder));
+                size++;
+                return true;
+            }
+            continue;
+        }
+        std::uint64_t version = node->version.load();
+        if (isShrinkingOrUnlinked(version))
+        {
+            waitUntilNotChanging(node);
+            continue;
+        }
+        if (node != rootHolder->right.load())
+        {
+            continue;
+        }
+        Outcome outcome = attemptUpdate(key, present, rootHolder, node, version);
+        if (outcome != Retry)
+        {
+            if (outcome == Hit && present)
+            {
+                size++;
+            }
+            else if (outcome == Hit)
+            {
+                size--;
+            }
+            return outcome == Hit;
+        }
+    }
+}
+
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Outcome
+BasicConcurrentAVLTree<Key, Compare>::attemptUpdate(const Key &key, bool present, Node *parent, Node *node, std::uint64_t version)
+{
+    int dir = compare(key, node->key);
+    if (dir == 0)
+    {
+        return attemptNodeUpdate(present, parent, node);
+    }
+    for (;;)
+    {
+        Node *child = node->child(dir);
+        if (node->version.load() != version)
+        {
+            return Retry;
+        }
+        if (child == nullptr)
+        {
+            if (!present)
+            {
+                return Miss;
+            }
+            Node *damaged;
+            {
+                std::lock_guard<std::mutex> guard(node->lock);
+                if (node->version.load() != version)
+                {
+                    return Retry;
+                }
+                if (node->child(dir) != nullptr)
+                {
+                    continue;
+                }
+                node->setChild(dir, new Node(key, 1, true, node));
+                damaged = fixHeight(node);
+            }
+            fixHeightAndRebalance(damaged);
+            return Hit;
+        }
+        std::uint64_t childVersion = child->version.load();
+        if (isShrinkingOrUnlinked(childVersion))
+        {
+            waitUntilNotChanging(child);
+            continue;
+        }
+        if (child != node->child(dir) || node->version.load() != version)
+        {
+            continue;
+        }
+        Outcome outcome = attemptUpdate(key, present, node, child, childVersion);
+        if (outcome != Retry)
+        {
+            return outcome;
+        }
+    }
+}
+
+// Insert over a routing node, or remove: in place when the node keeps its
+// place as a routing node, by splicing it out (parent and node locked)
+// when it has at most one child.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Outcome
+BasicConcurrentAVLTree<Key, Compare>::attemptNodeUpdate(bool present, Node *parent, Node *node)
+{
+    if (!present && !node->present.load())
+    {
+        return Miss;
+    }
+    if (!present && (node->left.load() == nullptr || node->right.load() == nullptr))
+    {
+        Node *damaged;
+        {
+            std::lock_guard<std::mutex> parentGuard(parent->lock);
+            if (parent->version.load() == unlinked || node->parent.load() != parent)
+            {
+                return Retry;
+            }
+            {
+                std::lock_guard<std::mutex> nodeGuard(node->lock);
+                if (!node->present.load())
+                {
+                    return Miss;
+                }
+                if (!attemptUnlink(parent, node))
+                {
+                    return Retry;
+                }
+            }
+            damaged = fixHeight(parent);
+        }
+        fixHeightAndRebalance(damaged);
+        return Hit;
+    }
+
+    std::lock_guard<std::mutex> guard(node->lock);
+    if (node->version.load() == unlinked)
+    {
+        return Retry;
+    }
+    if (node->present.load() == present)
+    {
+        return Miss;
+    }
+    if (!present && (node->left.load() == nullptr || node->right.load() == nullptr))
+    {
+        return Retry; // lost a child meanwhile; unlink it instead
+    }
+    node->present.store(present);
+    return Hit;
+}
+
+template <typename Key, typename Compare>
+bool BasicConcurrentAVLTree<Key, Compare>::attemptUnlink(Node *parent, Node *node)
+{
+    Node *parentLeft = parent->left.load();
+    Node *parentRight = parent->right.load();
+    if (parentLeft != node && parentRight != node)
+    {
+        return false;
+    }
+    Node *left = node->left.load();
+    Node *right = node->right.load();
+    if (left != nullptr && right != nullptr)
+    {
+        return false;
+    }
+    Node *splice = (left != nullptr) ? left : right;
+    if (parentLeft == node)
+    {
+        parent->left.store(splice);
+    }
+    else
+    {
+        parent->right.store(splice);
+    }
+    if (splice != nullptr)
+    {
+        splice->parent.store(parent);
+    }
+    node->version.store(unlinked);
+    node->present.store(false);
+    retire(node);
+    return true;
+}
+
+// What node needs: to be spliced out (an absent node with a free side), a
+// rotation, a new height (returned), or nothing.
+template <typename Key, typename Compare>
+int BasicConcurrentAVLTree<Key, Compare>::nodeCondition(Node *node)
+{
+    Node *left = node->left.load();
+    Node *right = node->right.load();
+    if ((left == nullptr || right == nullptr) && !node->present.load())
+    {
+        return unlinkRequired;
+    }
+    int leftHeight = height(left);
+    int rightHeight = height(right);
+    int balance = leftHeight - rightHeight;
+    if (balance < -1 || balance > 1)
+    {
+        return rebalanceRequired;
+    }
+    int repaired = 1 + std::max(leftHeight, rightHeight);
+    return (node->height.load() != repaired) ? repaired : nothingRequired;
+}
+
+// Returns the next node to look at: node itself if it needs more than a
+// new height, its parent if its height changed, nullptr if all is well.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Node *BasicConcurrentAVLTree<Key, Compare>::fixHeight(Node *node)
+{
+    int condition = nodeCondition(node);
+    if (condition == rebalanceRequired || condition == unlinkRequired)
+    {
+        return node;
+    }
+    if (condition == nothingRequired)
+    {
+        return nullptr;
+    }
+    node->height.store(condition);
+    return node->parent.load();
+}
+
+// Walk up from node, fixing heights and rotating, until a node needs
+// nothing. A rotation that hands back a node below it for more work leaves
+// the rotated node and its parent unfinished until that work is done, so
+// both are remembered and the walk resumes from them afterwards.
+template <typename Key, typename Compare>
+void BasicConcurrentAVLTree<Key, Compare>::fixHeightAndRebalance(Node *node)
+{
+    std::vector<Node *> deferred;
+    for (;;)
+    {
+        if (node == nullptr || node->parent.load() == nullptr || node->version.load() == unlinked)
+        {
+            if (deferred.empty())
+            {
+                return;
+            }
+            node = deferred.back();
+            deferred.pop_back();
+            continue;
+        }
+        int condition = nodeCondition(node);
+        if (condition == nothingRequired)
+        {
+            node = nullptr;
+            continue;
+        }
+        if (condition != unlinkRequired && condition != rebalanceRequired)
+        {
+            std::lock_guard<std::mutex> guard(node->lock);
+            node = fixHeight(node);
+            continue;
+        }
+        Node *parent = node->parent.load();
+        std::lock_guard<std::mutex> parentGuard(parent->lock);
+        if (parent->version.load() != unlinked && node->parent.load() == parent)
+        {
+            std::lock_guard<std::mutex> nodeGuard(node->lock);
+            Node *next = rebalance(parent, node);
+            if (next != nullptr && next != parent && next != parent->parent.load())
+            {
+                deferred.push_back(parent);
+                if (next != node)
+                {
+                    deferred.push_back(node);
+                }
+            }
+            node = next;
+        }
+    }
+}
+
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Node *BasicConcurrentAVLTree<Key, Compare>::rebalance(Node *parent, Node *node)
+{
+    Node *left = node->left.load();
+    Node *right = node->right.load();
+    if ((left == nullptr || right == nullptr) && !node->present.load())
+    {
+        return attemptUnlink(parent, node) ? fixHeight(parent) : node;
+    }
+    int leftHeight = height(left);
+    int rightHeight = height(right);
+    int balance = leftHeight - rightHeight;
+    if (balance > 1)
+    {
+        return rebalanceAway(parent, node, left, rightHeight, -1);
+    }
+    if (balance < -1)
+    {
+        return rebalanceAway(parent, node, right, leftHeight, 1);
+    }
+    int repaired = 1 + std::max(leftHeight, rightHeight);
+    if (node->height.load() != repaired)
+    {
+        node->height.store(repaired);
+        return fixHeight(parent);
+    }
+    return nullptr;
+}
+
+// node is too heavy on side `heavy` (-1 left, 1 right): rotate heavyChild
+// up, with a double rotation if its inner child is the taller one. Locks
+// heavyChild and, for a double rotation, its inner child. If the double
+// rotation would leave heavyChild unbalanced, rotates heavyChild first and
+// lets the repair walk come back for node.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Node *
+BasicConcurrentAVLTree<Key, Compare>::rebalanceAway(Node *parent, Node *node, Node *heavyChild, int lightHeight, int heavy)
+{
+    std::lock_guard<std::mutex> guard(heavyChild->lock);
+    if (heavyChild->height.load() - lightHeight <= 1)
+    {
+        return node; // changed since node was examined; look again
+    }
+    Node *inner = heavyChild->child(-heavy);
+    int outerHeight = height(heavyChild->child(heavy));
+    int innerHeight = height(inner);
+    if (outerHeight >= innerHeight)
+    {
+        return rotateSingle(parent, node, heavyChild, lightHeight, outerHeight, inner, innerHeight, heavy);
+    }
+    {
+        std::lock_guard<std::mutex> innerGuard(inner->lock);
+        innerHeight = inner->height.load();
+        if (outerHeight >= innerHeight)
+        {
+            return rotateSingle(parent, node, heavyChild, lightHeight, outerHeight, inner, innerHeight, heavy);
+        }
+        int innerOuterHeight = height(inner->child(heavy));
+        int balance = outerHeight - innerOuterHeight;
+        if (balance >= -1 && balance <= 1 && !((outerHeight == 0 || innerOuterHeight == 0) && !heavyChild->present.load()))
+        {
+            return rotateDouble(parent, node, heavyChild, lightHeight, outerHeight, inner, innerOuterHeight, heavy);
+        }
+        // The double rotation would leave heavyChild unbalanced or a routing
+        // node short of a child: rotate inner up over heavyChild alone, even
+        // if heavyChild is within balance, so that node's next look finds
+        // an outer-heavy child and a single rotation.
+        return rotateSingle(node, heavyChild, inner, outerHeight, height(inner->child(-heavy)),
+                            inner->child(heavy), innerOuterHeight, -heavy);
+    }
+}
+
+// heavyChild takes node's place and node becomes its child on the light
+// side, adopting heavyChild's inner subtree. Only node loses keys, so only
+// node's version moves.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Node *
+BasicConcurrentAVLTree<Key, Compare>::rotateSingle(Node *parent, Node *node, Node *heavyChild, int lightHeight, int outerHeight,
+                                                   Node *inner, int innerHeight, int heavy)
+{
+    std::uint64_t version = node->version.load();
+    Node *parentLeft = parent->left.load();
+    node->version.store(version | shrinking);
+
+    node->setChild(heavy, inner);
+    if (inner != nullptr)
+    {
+        inner->parent.store(node);
+    }
+    heavyChild->setChild(-heavy, node);
+    node->parent.store(heavyChild);
+    if (parentLeft == node)
+    {
+        parent->left.store(heavyChild);
+    }
+    else
+    {
+        parent->right.store(heavyChild);
+    }
+    heavyChild->parent.store(parent);
+
+    int nodeHeight = 1 + std::max(innerHeight, lightHeight);
+    node->height.store(nodeHeight);
+    heavyChild->height.store(1 + std::max(outerHeight, nodeHeight));
+    node->version.store(version + versionStep);
+
+    int nodeBalance = innerHeight - lightHeight;
+    if (nodeBalance < -1 || nodeBalance > 1 || ((inner == nullptr || lightHeight == 0) && !node->present.load()))
+    {
+        return node;
+    }
+    int topBalance = outerHeight - nodeHeight;
+    if (topBalance < -1 || topBalance > 1 || (outerHeight == 0 && !heavyChild->present.load()))
+    {
+        return heavyChild;
+    }
+    return fixHeight(parent);
+}
+
+// inner (heavyChild's inner child) takes node's place with heavyChild and
+// node as its children; both of those lose keys.
+template <typename Key, typename Compare>
+typename BasicConcurrentAVLTree<Key, Compare>::Node *
+BasicConcurrentAVLTree<Key, Compare>::rotateDouble(Node *parent, Node *node, Node *heavyChild, int lightHeight, int outerHeight,
+                                                   Node *inner, int innerOuterHeight, int heavy)
+{
+    std::uint64_t nodeVersion = node->version.load();
+    std::uint64_t heavyVersion = heavyChild->version.load();
+    Node *parentLeft = parent->left.load();
+    Node *innerOuter = inner->child(heavy);
+    Node *innerInner = inner->child(-heavy);
+    int innerInnerHeight = height(innerInner);
+    node->version.store(nodeVersion | shrinking);
+    heavyChild->version.store(heavyVersion | shrinking);
+
+    node->setChild(heavy, innerInner);
+    if (innerInner != nullptr)
+    {
+        innerInner->parent.store(node);
+    }
+    heavyChild->setChild(-heavy, innerOuter);
+    if (innerOuter != nullptr)
+    {
+        innerOuter->parent.store(heavyChild);
+    }
+    inner->setChild(heavy, heavyChild);
+    heavyChild->parent.store(inner);
+    inner->setChild(-heavy, node);
+    node->parent.store(inner);
+    if (parentLeft == node)
+    {
+        parent->left.store(inner);
+    }
+    else
+    {
+        parent->right.store(inner);
+    }
+    inner->parent.store(parent);
+
+    int nodeHeight = 1 + std::max(innerInnerHeight, lightHeight);
+    node->height.store(nodeHeight);
+    int heavyHeight = 1 + std::max(outerHeight, innerOuterHeight);
+    heavyChild->height.store(heavyHeight);
+    inner->height.store(1 + std::max(heavyHeight, nodeHeight));
+    node->version.store(nodeVersion + versionStep);
+    heavyChild->version.store(heavyVersion + versionStep);
+
+    int nodeBalance = innerInnerHeight - lightHeight;
+    if (nodeBalance < -1 || nodeBalance > 1 || ((innerInner == nullptr || lightHeight == 0) && !node->present.load()))
+    {
+        return node;
+    }
+    int topBalance = heavyHeight - nodeHeight;
+    if (topBalance < -1 || topBalance > 1)
+    {
+        return inner;
+    }
+    return fixHeight(parent);
+}
+
+#endif // CONCURRENTAVLTREE_H
@@ -0,0 +1,86 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#endif
+
+// CRC-32C (Castagnoli), the checksum used by snapshot files and log
+// records. Uses the SSE4.2 crc32 instruction when the CPU has it and a
+// table-driven software loop otherwise; both give the same result.
+namespace crc32c_detail
+{
+    struct Table
+    {
+        std::uint32_t entries[256];
+
+        Table()
+        {
+            for (std::uint32_t i = 0; i < 256; i++)
+            {
+                std::uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+                }
+                entries[i] = crc;
+            }
+        }
+    };
+
+    inline std::uint32_t software(std::uint32_t crc, const unsigned char *data, std::size_t length)
+    {
+        static const Table table;
+        for (std::size_t i = 0; i < length; i++)
+        {
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_X86
+    __attribute__((target("sse4.2"))) inline std::uint32_t hardware(std::uint32_t crc, const unsigned char *data, std::size_t length)
+    {
+        std::uint64_t wide = crc;
+        for (; length >= 8; data += 8, length -= 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            wide = _mm_crc32_u64(wide, word);
+        }
+        crc = static_cast<std::uint32_t>(wide);
+        for (; length > 0; data++, length--)
+        {
+            crc = _mm_crc32_u8(crc, *data);
+        }
+        return crc;
+    }
+
+    inline bool hardwareSupported()
+    {
+        static const bool supported = __builtin_cpu_supports("sse4.2");
+        return supported;
+    }
+#endif
+}
+
+// Extend crc (0 to start) over length bytes of data.
+inline std::uint32_t crc32c(const void *data, std::size_t length, std::uint32_t crc = 0)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#ifdef CRC32C_X86
+    if (crc32c_detail::hardwareSupported())
+    {
+        return ~crc32c_detail::hardware(crc, bytes, length);
+    }
+#endif
+    return ~crc32c_detail::software(crc, bytes, length);
+}
+
+#endif // CRC32C_H
@@ -0,0 +1,212 @@
+#ifndef DURABLEAVLTREE_H
+#define DURABLEAVLTREE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "AVLTree.h"
+#include "WriteAheadLog.h"
+
+// BasicAVLTree made crash-safe by a snapshot file plus a write-ahead log.
+// Each insert/remove/updateKey appends a log record before changing the
+// tree and returns the record's LSN. Records reach the disk by group
+// commit, so a mutation is durable once waitDurable(lsn) or sync() returns
+// (or after at most the log's group interval). On construction the latest
+// snapshot is loaded and the intact prefix of the log replayed over it; a
+// torn record left by a crash, and anything after it, is cut off.
+// checkpoint() writes a new snapshot and empties the log.
+//
+// The snapshot file is a 16-byte prefix (magic "AVLC", pad, the LSN of the
+// last mutation it includes) followed by BasicAVLTree::serialize() output,
+// so replay skips the records the snapshot already covers. Like
+// BasicAVLTree, a DurableAVLTree is for a single writer thread.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = std::allocator<Key>>
+class BasicDurableAVLTree
+{
+public: // For testing purposes
+    typedef BasicWriteAheadLog<Key> Log;
+
+    std::string snapshotPath;
+    std::string logPath;
+    BasicAVLTree<Key, Compare, Alloc> tree;
+    std::unique_ptr<Log> log;
+
+    void apply(LogOp op, const Key &key, const Key &other);
+    std::uint64_t loadSnapshot();
+
+public:
+    // Recover from the files at snapshotPath and logPath, either of which
+    // may be missing, then start logging. Throws std::runtime_error on I/O
+    // errors or a corrupt snapshot.
+    BasicDurableAVLTree(const std::string &snapshotPath, const std::string &logPath,
+                        std::chrono::microseconds groupInterval = std::chrono::microseconds(2000),
+                        std::size_t groupRecords = 65536);
+    BasicDurableAVLTree(const BasicDurableAVLTree &) = delete;
+    BasicDurableAVLTree &operator=(const BasicDurableAVLTree &) = delete;
+
+    std::uint64_t insert(const Key &key);
+    std::uint64_t remove(const Key &key);
+    std::uint64_t updateKey(const Key &oldKey, const Key &newKey);
+
+    void waitDurable(std::uint64_t lsn) { log->waitDurable(lsn); }
+    void sync() { log->sync(); }
+
+    // Write a snapshot atomically (temporary file, fsync, rename), then
+    // truncate the log.
+    void checkpoint();
+
+    // Read access to the recovered, up-to-date tree.
+    const BasicAVLTree<Key, Compare, Alloc> &contents() const { return tree; }
+    std::size_t getsize() const { return tree.size; }
+};
+
+typedef BasicDurableAVLTree<int> DurableAVLTree;
+
+template <typename Key, typename Compare, typename Alloc>
+BasicDurableAVLTree<Key, Compare, Alloc>::BasicDurableAVLTree(const std::string &snapshotPath, const std::string &logPath,
+                                                             std::chrono::microseconds groupInterval, std::size_t groupRecords)
+    : snapshotPath(snapshotPath), logPath(logPath)
+{
+    std::uint64_t snapshotLsn = loadSnapshot();
+    std::uint64_t lastLsn = snapshotLsn;
+    std::size_t intact = Log::replay(logPath, [&](LogOp op, std::uint64_t lsn, const Key &key, const Key &other) {
+        if (lsn > snapshotLsn)
+        {
+            apply(op, key, other);
+        }
+    }, lastLsn);
+    lastLsn = std::max(lastLsn, snapshotLsn);
+
+    if (::truncate(logPath.c_str(), static_cast<off_t>(intact)) != 0 && errno != ENOENT)
+    {
+        throw std::runtime_error("DurableAVLTree: cannot trim " + logPath + ": " + std::strerror(errno));
+    }
+    log.reset(new Log(logPath, lastLsn + 1, groupInterval, groupRecords));
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::uint64_t BasicDurableAVLTree<Key, Compare, Alloc>::loadSnapshot()
+{
+    std::ifstream in(snapshotPath, std::ios::binary);
+    if (!in)
+    {
+        return 0;
+    }
+    char prefix[16];
+    in.read(prefix, sizeof(prefix));
+    if (in.gcount() != sizeof(prefix) || std::memcmp(prefix, "AVLC", 4) != 0)
+    {
+        throw std::runtime_error("DurableAVLTree: " + snapshotPath + " is not a snapshot");
+    }
+    std::uint64_t lsn;
+    std::memcpy(&lsn, prefix + 8, sizeof(lsn));
+    tree.deserialize_in(in);
+    return lsn;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicDurableAVLTree<Key, Compare, Alloc>::apply(LogOp op, const Key &key, const Key &other)
+{
+    switch (op)
+    {
+    case LogOp::Insert:
+        tree.insert(key);
+        break;
+    case LogOp::Remove:
+        tree.remove(key);
+        break;
+    case LogOp::UpdateKey:
+        tree.updateKey(key, other);
+        break;
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::uint64_t BasicDurableAVLTree<Key, Compare, Alloc>::insert(const Key &key)
+{
+    std::uint64_t lsn = log->append(LogOp::Insert, key);
+    tree.insert(key);
+    return lsn;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::uint64_t BasicDurableAVLTree<Key, Compare, Alloc>::remove(const Key &key)
+{
+    std::uint64_t lsn = log->append(LogOp::Remove, key);
+    tree.remove(key);
+    return lsn;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+std::uint64_t BasicDurableAVLTree<Key, Compare, Alloc>::updateKey(const Key &oldKey, const Key &newKey)
+{
+    std::uint64_t lsn = log->append(LogOp::UpdateKey, oldKey, newKey);
+    tree.updateKey(oldKey, newKey);
+    return lsn;
+}
+
+template <typename Key, typename Compare, typename Alloc>
+void BasicDurableAVLTree<Key, Compare, Alloc>::checkpoint()
+{
+    std::uint64_t lsn = log->lastLsn();
+    std::ostringstream image;
+    char prefix[16] = {'A', 'V', 'L', 'C'};
+    std::memcpy(prefix + 8, &lsn, sizeof(lsn));
+    image.write(prefix, sizeof(prefix));
+    tree.serialize(image);
+    const std::string bytes = image.str();
+
+    std::string temporary = snapshotPath + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("DurableAVLTree: cannot create " + temporary + ": " + std::strerror(errno));
+    }
+    std::size_t written = 0;
+    while (written < bytes.size())
+    {
+        ssize_t count = ::write(fd, bytes.data() + written, bytes.size() - written);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        written += static_cast<std::size_t>(count);
+    }
+    bool synced = written == bytes.size() && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || std::rename(temporary.c_str(), snapshotPath.c_str()) != 0)
+    {
+        throw std::runtime_error("DurableAVLTree: cannot write " + snapshotPath + ": " + std::strerror(errno));
+    }
+
+    // The rename must be on disk before the log records it replaces are dropped
+    std::string::size_type slash = snapshotPath.rfind('/');
+    std::string directory = (slash == std::string::npos) ? "." : snapshotPath.substr(0, std::max<std::string::size_type>(slash, 1));
+    fd = ::open(directory.c_str(), O_RDONLY);
+    synced = fd >= 0 && ::fsync(fd) == 0;
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+    if (!synced)
+    {
+        throw std::runtime_error("DurableAVLTree: cannot sync " + directory + ": " + std::strerror(errno));
+    }
+    log->truncate();
+}
+
+#endif // DURABLEAVLTREE_H
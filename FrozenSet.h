@@ -0,0 +1,369 @@
+#ifndef FROZENSET_H
+#define FROZENSET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <vector>
+#include "AVLTree.h"
+
+// Searches over a sorted set stored in Eytzinger (BFS) order: node k has its
+// children at 2k and 2k + 1, indices start at 1 and 0 means "none". Node k
+// lives at tree[k - 1], so the functions work on any contiguous array of n
+// keys, whether owned by a BasicFrozenSet or mapped from a file.
+namespace eytzinger
+{
+    // Number of keys in one 64-byte cache line. Prefetching node k * keysPerLine
+    // fetches the line that holds all of k's descendants that many levels
+    // down, provided node 1 sits one key past a line boundary, as
+    // LineOffsetAllocator places it; otherwise they straddle two lines and
+    // the prefetch brings in the first of them.
+    template <typename Key>
+    struct Prefetch
+    {
+        static const std::size_t keysPerLine = (sizeof(Key) < 64) ? 64 / sizeof(Key) : 1;
+    };
+
+    template <typename Key>
+    inline void prefetch(const Key *tree, std::size_t n, std::size_t k)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(tree + std::min(k * Prefetch<Key>::keysPerLine, n) - 1);
+#else
+        (void)tree;
+        (void)n;
+        (void)k;
+#endif
+    }
+
+    // Allocator for Eytzinger arrays: storage starts one element past a
+    // 64-byte boundary, so that with node k at tree[k - 1] each node's
+    // descendants keysPerLine levels down share a single cache line.
+    template <typename T>
+    struct LineOffsetAllocator
+    {
+        typedef T value_type;
+
+        LineOffsetAllocator() {}
+        template <typename U>
+        LineOffsetAllocator(const LineOffsetAllocator<U> &) {}
+
+        // The block from operator new is remembered just below the
+        // boundary, which the slack of 64 + sizeof(void *) bytes leaves room for
+        T *allocate(std::size_t n)
+        {
+            char *raw = static_cast<char *>(::operator new(n * sizeof(T) + sizeof(T) + sizeof(void *) + 64));
+            std::uintptr_t boundary = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void *) + 63) & ~std::uintptr_t(63);
+            char *line = reinterpret_cast<char *>(boundary);
+            std::memcpy(line - sizeof(void *), &raw, sizeof(void *));
+            return reinterpret_cast<T *>(line + sizeof(T));
+        }
+
+        void deallocate(T *p, std::size_t)
+        {
+            char *raw;
+            std::memcpy(&raw, reinterpret_cast<char *>(p) - sizeof(T) - sizeof(void *), sizeof(void *));
+            ::operator delete(raw);
+        }
+
+        template <typename U>
+        bool operator==(const LineOffsetAllocator<U> &) const { return true; }
+        template <typename U>
+        bool operator!=(const LineOffsetAllocator<U> &) const { return false; }
+    };
+
+    // 1-based index of the lowest set bit of x, 0 if there is none.
+    inline int lowestSetBit(std::size_t x)
+    {
+#if defined(__GNUC__)
+        return __builtin_ffsll(static_cast<long long>(x));
+#else
+        if (x == 0)
+        {
+            return 0;
+        }
+        int bit = 1;
+        for (; (x & 1) == 0; x >>= 1)
+        {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    // Undo the turns taken after the last one of the given kind. A descent
+    // appends one bit per level (1 = went right); the answer is the node
+    // where the search last went left (for bounds) or right (for the
+    // predecessor), found by dropping the trailing run of the other turn and
+    // that turn itself.
+    inline std::size_t lastLeftTurn(std::size_t k)
+    {
+        return k >> lowestSetBit(~k);
+    }
+
+    inline std::size_t lastRightTurn(std::size_t k)
+    {
+        return k >> lowestSetBit(k);
+    }
+
+    // First key not less than key. The loop has no data-dependent branch:
+    // the comparison result is added straight into the next index.
+    template <typename Key, typename Compare>
+    std::size_t lowerBound(const Key *tree, std::size_t n, const Key &key, const Compare &comp)
+    {
+        std::size_t k = 1;
+        while (k <= n)
+        {
+            prefetch(tree, n, k);
+            k = 2 * k + comp(tree[k - 1], key);
+        }
+        return lastLeftTurn(k);
+    }
+
+    // First key greater than key.
+    template <typename Key, typename Compare>
+    std::size_t upperBound(const Key *tree, std::size_t n, const Key &key, const Compare &comp)
+    {
+        std::size_t k = 1;
+        while (k <= n)
+        {
+            prefetch(tree, n, k);
+            k = 2 * k + !comp(key, tree[k - 1]);
+        }
+        return lastLeftTurn(k);
+    }
+
+    // Last key less than key.
+    template <typename Key, typename Compare>
+    std::size_t predecessor(const Key *tree, std::size_t n, const Key &key, const Compare &comp)
+    {
+        std::size_t k = 1;
+        while (k <= n)
+        {
+            prefetch(tree, n, k);
+            k = 2 * k + comp(tree[k - 1], key);
+        }
+        return lastRightTurn(k);
+    }
+
+    template <typename Key, typename Compare>
+    bool contains(const Key *tree, std::size_t n, const Key &key, const Compare &comp)
+    {
+        std::size_t k = lowerBound(tree, n, key, comp);
+        return k != 0 && !comp(key, tree[k - 1]);
+    }
+
+    inline std::size_t first(std::size_t n)
+    {
+        std::size_t k = 0;
+        for (std::size_t next = 1; next <= n; next *= 2)
+        {
+            k = next;
+        }
+        return k;
+    }
+
+    inline std::size_t last(std::size_t n)
+    {
+        std::size_t k = 0;
+        for (std::size_t next = 1; next <= n; next = 2 * next + 1)
+        {
+            k = next;
+        }
+        return k;
+    }
+
+    // In-order neighbours of node k, 0 past either end; amortized O(1).
+    inline std::size_t next(std::size_t n, std::size_t k)
+    {
+        if (2 * k + 1 <= n)
+        {
+            k = 2 * k + 1;
+            while (2 * k <= n)
+            {
+                k = 2 * k;
+            }
+            return k;
+        }
+        return lastLeftTurn(k);
+    }
+
+    inline std::size_t prev(std::size_t n, std::size_t k)
+    {
+        if (2 * k <= n)
+        {
+            k = 2 * k;
+            while (2 * k + 1 <= n)
+            {
+                k = 2 * k + 1;
+            }
+            return k;
+        }
+        return lastRightTurn(k);
+    }
+
+    // Place count keys, read in ascending order from next, into tree.
+    template <typename InputIt, typename Key>
+    void build(InputIt next, std::size_t count, Key *tree)
+    {
+        for (std::size_t k = first(count); k != 0; k = eytzinger::next(count, k))
+        {
+            tree[k - 1] = *next;
+            ++next;
+        }
+    }
+}
+
+// Immutable sorted set in Eytzinger order, produced by BasicAVLTree::freeze()
+// for read-mostly workloads. The top levels of the implicit tree share a few
+// cache lines, descents are branch-free, and each step prefetches the line
+// holding the node's descendants four levels down (for 4-byte keys), so a
+// lookup costs far fewer dependent misses than chasing node pointers.
+template <typename Key, typename Compare = std::less<Key>>
+class BasicFrozenSet
+{
+public: // For testing purposes
+    std::vector<Key, eytzinger::LineOffsetAllocator<Key>> keys; // Eytzinger order; node k at keys[k - 1]
+    Compare comp;
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    // In-order iterator over the implicit tree: an index and the array it indexes.
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Key value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Key *pointer;
+        typedef const Key &reference;
+
+        const_iterator() : set(nullptr), k(0) {}
+
+        reference operator*() const { return set->keys[k - 1]; }
+        pointer operator->() const { return &set->keys[k - 1]; }
+
+        const_iterator &operator++()
+        {
+            k = eytzinger::next(set->keys.size(), k);
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator before(*this);
+            ++*this;
+            return before;
+        }
+
+        const_iterator &operator--()
+        {
+            k = (k == 0) ? eytzinger::last(set->keys.size()) : eytzinger::prev(set->keys.size(), k);
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator before(*this);
+            --*this;
+            return before;
+        }
+
+        bool operator==(const const_iterator &other) const { return k == other.k; }
+        bool operator!=(const const_iterator &other) const { return k != other.k; }
+
+    private:
+        friend class BasicFrozenSet;
+
+        const_iterator(const BasicFrozenSet *set, std::size_t k) : set(set), k(k) {}
+
+        const BasicFrozenSet *set;
+        std::size_t k;
+    };
+    typedef const_iterator iterator;
+
+    explicit BasicFrozenSet(const Compare &comp = Compare()) : comp(comp) {}
+
+    // From count strictly ascending keys read from first.
+    template <typename InputIt>
+    BasicFrozenSet(InputIt first, std::size_t count, const Compare &comp = Compare())
+        : keys(count), comp(comp)
+    {
+        eytzinger::build(first, count, keys.data());
+    }
+
+    std::size_t size() const { return keys.size(); }
+    bool empty() const { return keys.empty(); }
+
+    bool contains(const Key &key) const
+    {
+        return eytzinger::contains(keys.data(), keys.size(), key, comp);
+    }
+
+    const_iterator begin() const { return const_iterator(this, eytzinger::first(keys.size())); }
+    const_iterator end() const { return const_iterator(this, 0); }
+
+    const_iterator lower_bound(const Key &key) const
+    {
+        return const_iterator(this, eytzinger::lowerBound(keys.data(), keys.size(), key, comp));
+    }
+
+    const_iterator upper_bound(const Key &key) const
+    {
+        return const_iterator(this, eytzinger::upperBound(keys.data(), keys.size(), key, comp));
+    }
+
+    // Same answers and sentinel as BasicAVLTree::successor()/predecessor().
+    Key successor(const Key &key) const
+    {
+        std::size_t k = eytzinger::upperBound(keys.data(), keys.size(), key, comp);
+        return (k != 0) ? keys[k - 1] : notFound();
+    }
+
+    Key predecessor(const Key &key) const
+    {
+        std::size_t k = eytzinger::predecessor(keys.data(), keys.size(), key, comp);
+        return (k != 0) ? keys[k - 1] : notFound();
+    }
+
+    Key minimum() const
+    {
+        return empty() ? notFound() : keys[eytzinger::first(keys.size()) - 1];
+    }
+
+    Key maximum() const
+    {
+        return empty() ? notFound() : keys[eytzinger::last(keys.size()) - 1];
+    }
+
+    // Keys in [k1, k2] in ascending order.
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+    {
+        std::size_t n = keys.size();
+        for (std::size_t k = eytzinger::lowerBound(keys.data(), n, k1, comp); k != 0 && !comp(k2, keys[k - 1]); k = eytzinger::next(n, k))
+        {
+            *out++ = keys[k - 1];
+        }
+        return out;
+    }
+};
+
+typedef BasicFrozenSet<int> FrozenSet;
+
+template <typename Key, typename Compare, typename Alloc>
+BasicFrozenSet<Key, Compare> BasicAVLTree<Key, Compare, Alloc>::freeze() const
+{
+    return BasicFrozenSet<Key, Compare>(begin(), size, comp);
+}
+
+#endif // FROZENSET_H
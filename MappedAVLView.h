@@ -0,0 +1,215 @@
+#ifndef MAPPEDAVLVIEW_H
+#define MAPPEDAVLVIEW_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "FrozenSet.h"
+
+// Read-only view of a tree image file mapped straight into memory. The
+// image is a 64-byte header (magic "AVLI", format version, key size, key
+// count, offset of the keys) padded by one key, followed by the keys in
+// Eytzinger order, exactly as a BasicFrozenSet holds them. The mapping is
+// page-aligned, so the keys start one key past a line boundary, as
+// eytzinger::LineOffsetAllocator places them in memory and the prefetch
+// expects. Opening a view is O(1) whatever the size: nothing is decoded or
+// copied, and the lookups run the eytzinger:: searches over the mapped
+// pages. The mapping is shared, so processes viewing the same image share
+// one page-cache copy. Keys are stored in the host's byte order; an image
+// is meant for the machine that wrote it.
+template <typename Key, typename Compare = std::less<Key>>
+class BasicMappedAVLView
+{
+public: // For testing purposes
+    void *mapping;
+    std::size_t mappingSize;
+    const Key *keys; // Eytzinger order; node k at keys[k - 1]
+    std::size_t count;
+    Compare comp;
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+
+    static void writeHeader(std::ostream &out, std::size_t count);
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    static const std::uint32_t imageVersion = 2;
+    static const std::size_t imageHeaderSize = 64;
+    static const std::size_t imageKeyOffset = imageHeaderSize + sizeof(Key);
+
+    // Write an image of the set or tree that a view can map.
+    static void writeImage(std::ostream &out, const BasicFrozenSet<Key, Compare> &set);
+    template <typename Alloc>
+    static void writeImage(std::ostream &out, const BasicAVLTree<Key, Compare, Alloc> &tree);
+
+    // Map the image at path; throws std::runtime_error if it cannot be
+    // opened or is not a valid image for this key type.
+    explicit BasicMappedAVLView(const std::string &path, const Compare &comp = Compare());
+    BasicMappedAVLView(BasicMappedAVLView &&other);
+    BasicMappedAVLView(const BasicMappedAVLView &) = delete;
+    BasicMappedAVLView &operator=(const BasicMappedAVLView &) = delete;
+    ~BasicMappedAVLView();
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    bool contains(const Key &key) const
+    {
+        return eytzinger::contains(keys, count, key, comp);
+    }
+
+    // Same answers and sentinel as BasicAVLTree::successor()/predecessor().
+    Key successor(const Key &key) const
+    {
+        std::size_t k = eytzinger::upperBound(keys, count, key, comp);
+        return (k != 0) ? keys[k - 1] : notFound();
+    }
+
+    Key predecessor(const Key &key) const
+    {
+        std::size_t k = eytzinger::predecessor(keys, count, key, comp);
+        return (k != 0) ? keys[k - 1] : notFound();
+    }
+
+    Key minimum() const
+    {
+        return empty() ? notFound() : keys[eytzinger::first(count) - 1];
+    }
+
+    Key maximum() const
+    {
+        return empty() ? notFound() : keys[eytzinger::last(count) - 1];
+    }
+
+    // Keys in [k1, k2] in ascending order.
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+    {
+        for (std::size_t k = eytzinger::lowerBound(keys, count, k1, comp); k != 0 && !comp(k2, keys[k - 1]); k = eytzinger::next(count, k))
+        {
+            *out++ = keys[k - 1];
+        }
+        return out;
+    }
+};
+
+typedef BasicMappedAVLView<int> MappedAVLView;
+
+template <typename Key, typename Compare>
+const std::uint32_t BasicMappedAVLView<Key, Compare>::imageVersion;
+
+template <typename Key, typename Compare>
+const std::size_t BasicMappedAVLView<Key, Compare>::imageHeaderSize;
+
+template <typename Key, typename Compare>
+const std::size_t BasicMappedAVLView<Key, Compare>::imageKeyOffset;
+
+template <typename Key, typename Compare>
+void BasicMappedAVLView<Key, Compare>::writeHeader(std::ostream &out, std::size_t count)
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "images hold keys as raw bytes");
+
+    unsigned char header[imageKeyOffset] = {'A', 'V', 'L', 'I'};
+    std::uint32_t version = imageVersion;
+    std::uint32_t keySize = sizeof(Key);
+    std::uint64_t keyCount = count;
+    std::uint64_t keyOffset = imageKeyOffset;
+    std::memcpy(header + 4, &version, sizeof(version));
+    std::memcpy(header + 8, &keySize, sizeof(keySize));
+    std::memcpy(header + 16, &keyCount, sizeof(keyCount));
+    std::memcpy(header + 24, &keyOffset, sizeof(keyOffset));
+    out.write(reinterpret_cast<const char *>(header), imageKeyOffset);
+}
+
+template <typename Key, typename Compare>
+void BasicMappedAVLView<Key, Compare>::writeImage(std::ostream &out, const BasicFrozenSet<Key, Compare> &set)
+{
+    writeHeader(out, set.size());
+    out.write(reinterpret_cast<const char *>(set.keys.data()), set.size() * sizeof(Key));
+}
+
+template <typename Key, typename Compare>
+template <typename Alloc>
+void BasicMappedAVLView<Key, Compare>::writeImage(std::ostream &out, const BasicAVLTree<Key, Compare, Alloc> &tree)
+{
+    writeImage(out, tree.freeze());
+}
+
+template <typename Key, typename Compare>
+BasicMappedAVLView<Key, Compare>::BasicMappedAVLView(const std::string &path, const Compare &comp)
+    : mapping(nullptr), mappingSize(0), keys(nullptr), count(0), comp(comp)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("MappedAVLView: cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(imageKeyOffset))
+    {
+        ::close(fd);
+        throw std::runtime_error("MappedAVLView: " + path + " is not a tree image");
+    }
+    mappingSize = static_cast<std::size_t>(status.st_size);
+    mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    int mapError = errno; // before close() can overwrite it
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        mapping = nullptr;
+        throw std::runtime_error("MappedAVLView: cannot map " + path + ": " + std::strerror(mapError));
+    }
+
+    const unsigned char *header = static_cast<const unsigned char *>(mapping);
+    std::uint32_t version;
+    std::uint32_t keySize;
+    std::uint64_t keyCount;
+    std::uint64_t keyOffset;
+    std::memcpy(&version, header + 4, sizeof(version));
+    std::memcpy(&keySize, header + 8, sizeof(keySize));
+    std::memcpy(&keyCount, header + 16, sizeof(keyCount));
+    std::memcpy(&keyOffset, header + 24, sizeof(keyOffset));
+    if (std::memcmp(header, "AVLI", 4) != 0 || version != imageVersion || keySize != sizeof(Key) || keyOffset != imageKeyOffset ||
+        keyCount != (mappingSize - imageKeyOffset) / sizeof(Key) || (mappingSize - imageKeyOffset) % sizeof(Key) != 0)
+    {
+        ::munmap(mapping, mappingSize);
+        mapping = nullptr;
+        throw std::runtime_error("MappedAVLView: " + path + " is not a tree image for this key type");
+    }
+    keys = reinterpret_cast<const Key *>(header + imageKeyOffset);
+    count = static_cast<std::size_t>(keyCount);
+}
+
+template <typename Key, typename Compare>
+BasicMappedAVLView<Key, Compare>::BasicMappedAVLView(BasicMappedAVLView &&other)
+    : mapping(other.mapping), mappingSize(other.mappingSize), keys(other.keys), count(other.count), comp(other.comp)
+{
+    other.mapping = nullptr;
+    other.mappingSize = 0;
+    other.keys = nullptr;
+    other.count = 0;
+}
+
+template <typename Key, typename Compare>
+BasicMappedAVLView<Key, Compare>::~BasicMappedAVLView()
+{
+    if (mapping != nullptr)
+    {
+        ::munmap(mapping, mappingSize);
+    }
+}
+
+#endif // MAPPEDAVLVIEW_H
@@ -0,0 +1,430 @@
+#ifndef PERSISTENTAVLTREE_H
+#define PERSISTENTAVLTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include "AVLTree.h"
+
+// AVL tree whose versions share structure. Nodes are immutable once built:
+// insert and remove copy only the O(log n) path from the root to the
+// change, plus the few nodes a rotation touches, and the new version points
+// at every untouched subtree of the old one. Each node counts the
+// references to it (parents and snapshot handles) and is freed when the
+// count drops to zero, so an old version lives exactly as long as someone
+// holds it. snapshot() is O(1): it takes one reference to the current root.
+//
+// The tree itself is for one writer thread. A Snapshot may be handed to
+// other threads and read, copied or dropped there without any locking while
+// the writer keeps going; reference counts are atomic and nodes come from
+// the global heap rather than an AVLNodePool, since the last reference to
+// a node may be dropped on any thread.
+template <typename Key, typename Compare = std::less<Key>>
+class BasicPersistentAVLTree
+{
+public: // For testing purposes
+    struct Node
+    {
+        Key data;
+        const Node *left;
+        const Node *right;
+        int height;
+        mutable std::atomic<unsigned> references;
+
+        Node(const Key &data, const Node *left, const Node *right)
+            : data(data), left(left), right(right),
+              height(1 + std::max(left ? left->height : 0, right ? right->height : 0)), references(1)
+        {
+        }
+    };
+
+    const Node *root;
+    std::size_t size;
+    Compare comp;
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+    static int height(const Node *node) { return node ? node->height : 0; }
+
+    static const Node *retain(const Node *node);
+    static void release(const Node *node);
+
+    // Building blocks; each takes over the references passed in for left and right.
+    static const Node *balance(const Key &data, const Node *left, const Node *right);
+    const Node *insert(const Node *node, const Key &key);
+    const Node *remove(const Node *node, const Key &key, bool &found);
+    static const Node *removeMinimum(const Node *node, Key &minimum);
+
+    // Read-only walks shared by the tree and its snapshots.
+    static bool contains(const Node *node, const Key &key, const Compare &comp);
+    static Key successor(const Node *node, const Key &key, const Compare &comp);
+    static Key predecessor(const Node *node, const Key &key, const Compare &comp);
+    static Key minimum(const Node *node);
+    static Key maximum(const Node *node);
+    template <typename OutputIt>
+    static OutputIt rangeSearch(const Node *node, const Key &k1, const Key &k2, const Compare &comp, OutputIt out);
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    // Immutable version of the tree. Cheap to copy: a copy is one more
+    // reference to the same root.
+    class Snapshot
+    {
+    public:
+        Snapshot(const Snapshot &other) : root(retain(other.root)), count(other.count), comp(other.comp) {}
+        Snapshot &operator=(Snapshot other)
+        {
+            std::swap(root, other.root);
+            std::swap(count, other.count);
+            std::swap(comp, other.comp);
+            return *this;
+        }
+        ~Snapshot() { release(root); }
+
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        int height() const { return BasicPersistentAVLTree::height(root); }
+
+        bool contains(const Key &key) const { return BasicPersistentAVLTree::contains(root, key, comp); }
+        Key successor(const Key &key) const { return BasicPersistentAVLTree::successor(root, key, comp); }
+        Key predecessor(const Key &key) const { return BasicPersistentAVLTree::predecessor(root, key, comp); }
+        Key minimum() const { return BasicPersistentAVLTree::minimum(root); }
+        Key maximum() const { return BasicPersistentAVLTree::maximum(root); }
+
+        // Keys in [k1, k2] in ascending order.
+        template <typename OutputIt>
+        OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+        {
+            return BasicPersistentAVLTree::rangeSearch(root, k1, k2, comp, out);
+        }
+
+    private:
+        friend class BasicPersistentAVLTree;
+
+        Snapshot(const Node *root, std::size_t count, const Compare &comp) : root(retain(root)), count(count), comp(comp) {}
+
+        const Node *root;
+        std::size_t count;
+        Compare comp;
+    };
+
+    explicit BasicPersistentAVLTree(const Compare &comp = Compare()) : root(nullptr), size(0), comp(comp) {}
+    BasicPersistentAVLTree(const BasicPersistentAVLTree &) = delete;
+    BasicPersistentAVLTree &operator=(const BasicPersistentAVLTree &) = delete;
+    ~BasicPersistentAVLTree() { release(root); }
+
+    void insert(const Key &key);
+    void remove(const Key &key);
+    void clear();
+
+    Snapshot snapshot() const { return Snapshot(root, size, comp); }
+
+    std::size_t getsize() const { return size; }
+    int height() const { return height(root); }
+    bool contains(const Key &key) const { return contains(root, key, comp); }
+    Key successor(const Key &key) const { return successor(root, key, comp); }
+    Key predecessor(const Key &key) const { return predecessor(root, key, comp); }
+    Key minimum() const { return minimum(root); }
+    Key maximum() const { return maximum(root); }
+
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+    {
+        return rangeSearch(root, k1, k2, comp, out);
+    }
+};
+
+typedef BasicPersistentAVLTree<int> PersistentAVLTree;
+
+template <typename Key, typename Compare>
+const typename BasicPersistentAVLTree<Key, Compare>::Node *BasicPersistentAVLTree<Key, Compare>::retain(const Node *node)
+{
+    if (node != nullptr)
+    {
+        node->references.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+// Dropping the last reference frees the node and drops its references to
+// its children, so a version's private nodes go in one cascade that stops
+// at the first node another version still shares. It recurses into left
+// children and loops on right ones, so the stack stays within the height.
+template <typename Key, typename Compare>
+void BasicPersistentAVLTree<Key, Compare>::release(const Node *node)
+{
+    while (node != nullptr && node->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        const Node *right = node->right;
+        release(node->left);
+        delete node;
+        node = right;
+    }
+}
+
+// New node over left and right, with one single or double rotation if
+// their heights differ by two. The rotated-away child is dropped after its
+// children are retained for the new nodes, which frees it if this update
+// built it and leaves it alone if an older version shares it.
+template <typename Key, typename Compare>
+const typename BasicPersistentAVLTree<Key, Compare>::Node *BasicPersistentAVLTree<Key, Compare>::balance(const Key &data, const Node *left, const Node *right)
+{
+    const Node *result;
+    if (height(left) > height(right) + 1)
+    {
+        if (height(left->left) >= height(left->right))
+        {
+            result = new Node(left->data, retain(left->left), new Node(data, retain(left->right), right));
+        }
+        else
+        {
+            const Node *middle = left->right;
+            result = new Node(middle->data, new Node(left->data, retain(left->left), retain(middle->left)),
+                              new Node(data, retain(middle->right), right));
+        }
+        release(left);
+        return result;
+    }
+    if (height(right) > height(left) + 1)
+    {
+        if (height(right->right) >= height(right->left))
+        {
+            result = new Node(right->data, new Node(data, left, retain(right->left)), retain(right->right));
+        }
+        else
+        {
+            const Node *middle = right->left;
+            result = new Node(middle->data, new Node(data, left, retain(middle->left)),
+                              new Node(right->data, retain(middle->right), retain(right->right)));
+        }
+        release(right);
+        return result;
+    }
+    return new Node(data, left, right);
+}
+
+// Returns the new version of node's subtree, or nullptr if key is already
+// there and nothing was copied.
+template <typename Key, typename Compare>
+const typename BasicPersistentAVLTree<Key, Compare>::Node *BasicPersistentAVLTree<Key, Compare>::insert(const Node *node, const Key &key)
+{
+    if (node == nullptr)
+    {
+        return new Node(key, nullptr, nullptr);
+    }
+    if (comp(key, node->data))
+    {
+        const Node *left = insert(node->left, key);
+        return left ? balance(node->data, left, retain(node->right)) : nullptr;
+    }
+    if (comp(node->data, key))
+    {
+        const Node *right = insert(node->right, key);
+        return right ? balance(node->data, retain(node->left), right) : nullptr;
+    }
+    return nullptr;
+}
+
+template <typename Key, typename Compare>
+const typename BasicPersistentAVLTree<Key, Compare>::Node *BasicPersistentAVLTree<Key, Compare>::removeMinimum(const Node *node, Key &minimum)
+{
+    if (node->left == nullptr)
+    {
+        minimum = node->data;
+        return retain(node->right);
+    }
+    const Node *left = removeMinimum(node->left, minimum);
+    return balance(node->data, left, retain(node->right));
+}
+
+// Returns the new version of node's subtree; found says whether key was
+// there (if not, nothing was copied and the result is meaningless).
+template <typename Key, typename Compare>
+const typename BasicPersistentAVLTree<Key, Compare>::Node *BasicPersistentAVLTree<Key, Compare>::remove(const Node *node, const Key &key, bool &found)
+{
+    if (node == nullptr)
+    {
+        found = false;
+        return nullptr;
+    }
+    if (comp(key, node->data))
+    {
+        const Node *left = remove(node->left, key, found);
+        return found ? balance(node->data, left, retain(node->right)) : nullptr;
+    }
+    if (comp(node->data, key))
+    {
+        const Node *right = remove(node->right, key, found);
+        return found ? balance(node->data, retain(node->left), right) : nullptr;
+    }
+    found = true;
+    if (node->left == nullptr)
+    {
+        return retain(node->right);
+    }
+    if (node->right == nullptr)
+    {
+        return retain(node->left);
+    }
+    Key replacement;
+    const Node *right = removeMinimum(node->right, replacement);
+    return balance(replacement, retain(node->left), right);
+}
+
+template <typename Key, typename Compare>
+void BasicPersistentAVLTree<Key, Compare>::insert(const Key &key)
+{
+    const Node *updated = insert(root, key);
+    if (updated != nullptr)
+    {
+        release(root);
+        root = updated;
+        size++;
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicPersistentAVLTree<Key, Compare>::remove(const Key &key)
+{
+    bool found;
+    const Node *updated = remove(root, key, found);
+    if (found)
+    {
+        release(root);
+        root = updated;
+        size--;
+    }
+}
+
+template <typename Key, typename Compare>
+void BasicPersistentAVLTree<Key, Compare>::clear()
+{
+    release(root);
+    root = nullptr;
+    size = 0;
+}
+
+template <typename Key, typename Compare>
+bool BasicPersistentAVLTree<Key, Compare>::contains(const Node *node, const Key &key, const Compare &comp)
+{
+    while (node != nullptr)
+    {
+        if (comp(key, node->data))
+        {
+            node = node->left;
+        }
+        else if (comp(node->data, key))
+        {
+            node = node->right;
+        }
+        else
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Key, typename Compare>
+Key BasicPersistentAVLTree<Key, Compare>::successor(const Node *node, const Key &key, const Compare &comp)
+{
+    const Node *best = nullptr;
+    while (node != nullptr)
+    {
+        if (comp(key, node->data))
+        {
+            best = node;
+            node = node->left;
+        }
+        else
+        {
+            node = node->right;
+        }
+    }
+    return best ? best->data : notFound();
+}
+
+template <typename Key, typename Compare>
+Key BasicPersistentAVLTree<Key, Compare>::predecessor(const Node *node, const Key &key, const Compare &comp)
+{
+    const Node *best = nullptr;
+    while (node != nullptr)
+    {
+        if (comp(node->data, key))
+        {
+            best = node;
+            node = node->right;
+        }
+        else
+        {
+            node = node->left;
+        }
+    }
+    return best ? best->data : notFound();
+}
+
+template <typename Key, typename Compare>
+Key BasicPersistentAVLTree<Key, Compare>::minimum(const Node *node)
+{
+    if (node == nullptr)
+    {
+        return notFound();
+    }
+    while (node->left != nullptr)
+    {
+        node = node->left;
+    }
+    return node->data;
+}
+
+template <typename Key, typename Compare>
+Key BasicPersistentAVLTree<Key, Compare>::maximum(const Node *node)
+{
+    if (node == nullptr)
+    {
+        return notFound();
+    }
+    while (node->right != nullptr)
+    {
+        node = node->right;
+    }
+    return node->data;
+}
+
+// Stack walk bounded by the height; Morris threading is not an option on
+// nodes other versions are reading.
+template <typename Key, typename Compare>
+template <typename OutputIt>
+OutputIt BasicPersistentAVLTree<Key, Compare>::rangeSearch(const Node *node, const Key &k1, const Key &k2, const Compare &comp, OutputIt out)
+{
+    const Node *pending[BasicAVLTree<Key, Compare>::maxHeight];
+    int depth = 0;
+    while (node != nullptr || depth > 0)
+    {
+        if (node != nullptr)
+        {
+            if (comp(node->data, k1))
+            {
+                node = node->right;
+                continue;
+            }
+            pending[depth++] = node;
+            node = node->left;
+            continue;
+        }
+        node = pending[--depth];
+        if (comp(k2, node->data))
+        {
+            break;
+        }
+        *out++ = node->data;
+        node = node->right;
+    }
+    return out;
+}
+
+#endif // PERSISTENTAVLTREE_H
@@ -0,0 +1,126 @@
+#ifndef READERWRITERLOCK_H
+#define READERWRITERLOCK_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+// Reader-writer lock for read-mostly data. Instead of one shared reader
+// count, whose cache line every reader would write, each thread counts
+// itself in one of several reader slots, one cache line apiece, so readers
+// on different threads never touch the same line. A writer serializes
+// with other writers, raises the writer flag to turn new readers away and
+// waits until every slot has drained; readers that meet the flag back out
+// and wait for it to drop, so writers are not starved. Both sides use
+// sequentially consistent operations: a reader either sees the flag or is
+// seen by the writer's scan. Neither side is reentrant.
+class ReaderWriterLock
+{
+public: // For testing purposes
+    struct Slot
+    {
+        std::atomic<int> readers;
+        char pad[64 - sizeof(std::atomic<int>)]; // one cache line per slot
+
+        Slot() : readers(0) {}
+    };
+
+    // The slots are placed by hand on a 64-byte boundary: C++11 containers
+    // do not honour over-aligned element types, and a slot straddling two
+    // lines would share one with its neighbour.
+    std::unique_ptr<char[]> storage;
+    Slot *slots;
+    std::size_t slotCount;
+    std::atomic<bool> writing;
+    std::mutex writerLock;
+
+    // Threads are given slots round robin the first time they read, and
+    // keep theirs, so lock_shared and unlock_shared always agree.
+    std::size_t currentSlot() const
+    {
+        static std::atomic<unsigned> nextThread(0);
+        static thread_local unsigned thread = nextThread.fetch_add(1);
+        return thread % slotCount;
+    }
+
+public:
+    // slotCount 0 means one slot per hardware thread.
+    explicit ReaderWriterLock(unsigned slotCount = 0)
+        : slotCount(slotCount != 0 ? slotCount : std::max(1u, std::thread::hardware_concurrency())), writing(false)
+    {
+        storage.reset(new char[this->slotCount * sizeof(Slot) + 63]);
+        std::uintptr_t base = (reinterpret_cast<std::uintptr_t>(storage.get()) + 63) & ~std::uintptr_t(63);
+        slots = reinterpret_cast<Slot *>(base);
+        for (std::size_t i = 0; i < this->slotCount; i++)
+        {
+            new (&slots[i]) Slot();
+        }
+    }
+
+    // Slot is trivially destructible, so the storage is simply freed.
+
+    ReaderWriterLock(const ReaderWriterLock &) = delete;
+    ReaderWriterLock &operator=(const ReaderWriterLock &) = delete;
+
+    void lock_shared()
+    {
+        std::atomic<int> &readers = slots[currentSlot()].readers;
+        for (;;)
+        {
+            readers.fetch_add(1);
+            if (!writing.load())
+            {
+                return;
+            }
+            readers.fetch_sub(1);
+            while (writing.load())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock_shared()
+    {
+        slots[currentSlot()].readers.fetch_sub(1);
+    }
+
+    void lock()
+    {
+        writerLock.lock();
+        writing.store(true);
+        for (std::size_t i = 0; i < slotCount; i++)
+        {
+            while (slots[i].readers.load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock()
+    {
+        writing.store(false);
+        writerLock.unlock();
+    }
+};
+
+// RAII holder for the shared side, like std::lock_guard for the exclusive one.
+class SharedLockGuard
+{
+public:
+    explicit SharedLockGuard(ReaderWriterLock &lock) : lock(lock) { lock.lock_shared(); }
+    ~SharedLockGuard() { lock.unlock_shared(); }
+    SharedLockGuard(const SharedLockGuard &) = delete;
+    SharedLockGuard &operator=(const SharedLockGuard &) = delete;
+
+private:
+    ReaderWriterLock &lock;
+};
+
+#endif // READERWRITERLOCK_H
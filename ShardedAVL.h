@@ -0,0 +1,535 @@
+#ifndef SHARDEDAVL_H
+#define SHARDEDAVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "AVLTree.h"
+
+// How a BasicShardedAVL spreads keys over its shards.
+//  Range: shard i holds the keys from its lower bound up to the next
+//         shard's; ordered queries visit only the shards they need.
+//  Hash:  a key's shard is picked by its hash, which spreads any key
+//         distribution evenly but makes every ordered query visit, and
+//         merge the answers of, all shards.
+enum class ShardMode
+{
+    Range,
+    Hash
+};
+
+// A set split over a fixed number of BasicAVLTree shards, each behind its
+// own mutex, so writers to different shards do not wait for each other.
+// Point operations lock one shard. Ordered queries lock the shards they
+// need in ascending shard order (all of them for Hash mode and on the
+// slow paths; maximum walks down with try_lock instead) and hold them
+// until done, so each answer is a consistent view of the set.
+//
+// In Range mode, writers find their shard from the shard lower bounds,
+// read without locking, and recheck under the shard's lock that the key
+// still belongs there. Arithmetic keys start with the bounds spread evenly
+// over the whole key domain; any other key type starts with every key in
+// one shard. Once the first minShardKeys keys are in, the bounds are
+// re-cut from those keys. After that, when an insert leaves a shard holding
+// more than skewLimit times the average, and the set has at least
+// minShardKeys keys per shard, they are cut again. Cutting locks every
+// shard and splits the keys evenly with O(n) bulk builds. Key is read
+// atomically for this, so it must be trivially copyable.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = std::allocator<Key>, typename Hash = std::hash<Key>>
+class BasicShardedAVL
+{
+public: // For testing purposes
+    typedef BasicAVLTree<Key, Compare, Alloc> Tree;
+    typedef typename Tree::const_iterator TreeIterator;
+    typedef std::unique_lock<std::mutex> ShardLock;
+
+    struct Shard
+    {
+        std::mutex lock;
+        Tree tree;
+        std::atomic<Key> lower; // Range mode; unused by shard 0
+
+        Shard(const Compare &comp, const Key &lower) : tree(comp), lower(lower) {}
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    ShardMode mode;
+    double skewLimit;
+    std::size_t minShardKeys;
+    Compare comp;
+    Hash hash;
+    std::atomic<std::size_t> size;
+    std::atomic<bool> resharding;
+    std::atomic<bool> sampled; // bounds have been cut from the keys at least once
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+    static Key initialBound(std::size_t index, std::size_t count, std::true_type);
+    static Key initialBound(std::size_t, std::size_t, std::false_type) { return Key(); }
+
+    std::size_t rangeShard(const Key &key) const;
+    bool owns(std::size_t index, const Key &key) const;
+    std::size_t lockShardFor(const Key &key, ShardLock &guard) const;
+    void lockAll(std::vector<ShardLock> &guards) const;
+    void reshardIfSkewed(std::size_t shardSize);
+    void reshard(std::size_t minimumKeys);
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    static const std::size_t defaultShardCount = 16;
+
+    explicit BasicShardedAVL(std::size_t shardCount = defaultShardCount, ShardMode mode = ShardMode::Range,
+                             double skewLimit = 2.0, std::size_t minShardKeys = 1024, const Compare &comp = Compare());
+    BasicShardedAVL(const BasicShardedAVL &) = delete;
+    BasicShardedAVL &operator=(const BasicShardedAVL &) = delete;
+
+    // Safe to call from any number of threads at once. insert and remove
+    // return whether the set changed.
+    bool insert(const Key &key);
+    bool remove(const Key &key);
+    bool contains(const Key &key) const;
+    std::size_t getsize() const { return size.load(); }
+    std::size_t shardCount() const { return shards.size(); }
+
+    // Same answers and sentinel as BasicAVLTree's.
+    Key minimum() const;
+    Key maximum() const;
+    Key successor(const Key &key) const;
+    Key predecessor(const Key &key) const;
+
+    // Keys in [k1, k2] in ascending order.
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const;
+};
+
+typedef BasicShardedAVL<int> ShardedAVL;
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+const std::size_t BasicShardedAVL<Key, Compare, Alloc, Hash>::defaultShardCount;
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+BasicShardedAVL<Key, Compare, Alloc, Hash>::BasicShardedAVL(std::size_t shardCount, ShardMode mode, double skewLimit,
+                                                            std::size_t minShardKeys, const Compare &comp)
+    : mode(mode), skewLimit(skewLimit), minShardKeys(minShardKeys), comp(comp), size(0), resharding(false), sampled(false)
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "shard bounds are read without locks");
+
+    shardCount = std::max<std::size_t>(shardCount, 1);
+    for (std::size_t i = 0; i < shardCount; i++)
+    {
+        shards.push_back(std::unique_ptr<Shard>(new Shard(comp, initialBound(i, shardCount, std::is_arithmetic<Key>()))));
+    }
+}
+
+// Shard index's share of [lowest, max], as lowest / count * (count - index)
+// + max / count * index, whose terms each stay within the domain.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+Key BasicShardedAVL<Key, Compare, Alloc, Hash>::initialBound(std::size_t index, std::size_t count, std::true_type)
+{
+    const Key lowest = std::numeric_limits<Key>::lowest();
+    const Key highest = std::numeric_limits<Key>::max();
+    const Key parts = static_cast<Key>(count);
+    return static_cast<Key>(lowest / parts * static_cast<Key>(count - index) + highest / parts * static_cast<Key>(index));
+}
+
+// The last shard whose lower bound is not above key. Bounds may be
+// changing under a reshard; the caller checks the answer under the lock.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+std::size_t BasicShardedAVL<Key, Compare, Alloc, Hash>::rangeShard(const Key &key) const
+{
+    std::size_t low = 1;
+    std::size_t high = shards.size();
+    while (low < high)
+    {
+        std::size_t middle = low + (high - low) / 2;
+        if (comp(key, shards[middle]->lower.load()))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return low - 1;
+}
+
+// Only meaningful with shard index locked, which keeps reshard() out.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+bool BasicShardedAVL<Key, Compare, Alloc, Hash>::owns(std::size_t index, const Key &key) const
+{
+    return (index == 0 || !comp(key, shards[index]->lower.load())) &&
+           (index + 1 == shards.size() || comp(key, shards[index + 1]->lower.load()));
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+std::size_t BasicShardedAVL<Key, Compare, Alloc, Hash>::lockShardFor(const Key &key, ShardLock &guard) const
+{
+    if (mode == ShardMode::Hash)
+    {
+        std::size_t index = hash(key) % shards.size();
+        guard = ShardLock(shards[index]->lock);
+        return index;
+    }
+    for (;;)
+    {
+        std::size_t index = rangeShard(key);
+        guard = ShardLock(shards[index]->lock);
+        if (owns(index, key))
+        {
+            return index;
+        }
+        guard.unlock();
+    }
+}
+
+// Ascending order, like every multi-shard lock, so they cannot deadlock.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+void BasicShardedAVL<Key, Compare, Alloc, Hash>::lockAll(std::vector<ShardLock> &guards) const
+{
+    guards.reserve(shards.size());
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        guards.push_back(ShardLock(shards[i]->lock));
+    }
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+bool BasicShardedAVL<Key, Compare, Alloc, Hash>::insert(const Key &key)
+{
+    std::size_t shardSize;
+    {
+        ShardLock guard;
+        Tree &tree = shards[lockShardFor(key, guard)]->tree;
+        std::size_t before = tree.size;
+        tree.insert(key);
+        shardSize = tree.size;
+        if (shardSize == before)
+        {
+            return false;
+        }
+    }
+    size.fetch_add(1);
+    reshardIfSkewed(shardSize);
+    return true;
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+bool BasicShardedAVL<Key, Compare, Alloc, Hash>::remove(const Key &key)
+{
+    ShardLock guard;
+    Tree &tree = shards[lockShardFor(key, guard)]->tree;
+    std::size_t before = tree.size;
+    tree.remove(key);
+    if (tree.size == before)
+    {
+        return false;
+    }
+    size.fetch_sub(1);
+    return true;
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+bool BasicShardedAVL<Key, Compare, Alloc, Hash>::contains(const Key &key) const
+{
+    ShardLock guard;
+    return shards[lockShardFor(key, guard)]->tree.contains(key);
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+void BasicShardedAVL<Key, Compare, Alloc, Hash>::reshardIfSkewed(std::size_t shardSize)
+{
+    if (mode != ShardMode::Range || shards.size() == 1)
+    {
+        return;
+    }
+    std::size_t total = size.load();
+    std::size_t minimumKeys = sampled.load() ? minShardKeys * shards.size() : minShardKeys;
+    if (total < minimumKeys || (sampled.load() && shardSize <= skewLimit * total / shards.size()))
+    {
+        return;
+    }
+    if (!resharding.exchange(true))
+    {
+        reshard(minimumKeys);
+        resharding.store(false);
+    }
+}
+
+// Stop the world: lock every shard, gather the keys in order (the shards
+// are already in key order) and rebuild each shard from an equal slice.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+void BasicShardedAVL<Key, Compare, Alloc, Hash>::reshard(std::size_t minimumKeys)
+{
+    std::vector<ShardLock> guards;
+    lockAll(guards);
+    std::size_t total = size.load();
+    if (total < std::max(minimumKeys, shards.size()))
+    {
+        return; // removes got here first, or too few keys to give each shard one
+    }
+
+    std::vector<Key> keys;
+    keys.reserve(total);
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        shards[i]->tree.inorderTraversal(std::back_inserter(keys));
+    }
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        std::size_t first = keys.size() * i / shards.size();
+        std::size_t last = keys.size() * (i + 1) / shards.size();
+        shards[i]->tree.buildFromSorted(keys.begin() + first, keys.begin() + last);
+        if (i != 0)
+        {
+            shards[i]->lower.store(keys[first]);
+        }
+    }
+    sampled.store(true);
+}
+
+// Range mode: the first non-empty shard holds the answer. Shards are
+// locked one at a time in ascending order, and the empty ones passed stay
+// locked so no smaller key can land in them before the answer is read.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+Key BasicShardedAVL<Key, Compare, Alloc, Hash>::minimum() const
+{
+    std::vector<ShardLock> guards;
+    if (mode == ShardMode::Range)
+    {
+        for (std::size_t i = 0; i < shards.size(); i++)
+        {
+            guards.push_back(ShardLock(shards[i]->lock));
+            if (shards[i]->tree.size != 0)
+            {
+                return *shards[i]->tree.begin();
+            }
+        }
+        return notFound();
+    }
+
+    lockAll(guards);
+    bool found = false;
+    Key best = notFound();
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        const Tree &tree = shards[i]->tree;
+        if (tree.size != 0 && (!found || comp(*tree.begin(), best)))
+        {
+            best = *tree.begin();
+            found = true;
+        }
+    }
+    return best;
+}
+
+// Range mode: the last non-empty shard holds the answer. The scan runs
+// against the ascending lock order, so below the first shard it only
+// try_locks, and starts over if a shard is busy rather than wait for it
+// while holding a later one.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+Key BasicShardedAVL<Key, Compare, Alloc, Hash>::maximum() const
+{
+    std::vector<ShardLock> guards;
+    if (mode == ShardMode::Range)
+    {
+        for (;;)
+        {
+            std::size_t i = shards.size();
+            for (; i-- > 0;)
+            {
+                ShardLock guard(shards[i]->lock, std::defer_lock);
+                if (guards.empty())
+                {
+                    guard.lock();
+                }
+                else if (!guard.try_lock())
+                {
+                    break;
+                }
+                guards.push_back(std::move(guard));
+                if (shards[i]->tree.size != 0)
+                {
+                    return *shards[i]->tree.rbegin();
+                }
+            }
+            if (i == std::size_t(-1))
+            {
+                return notFound();
+            }
+            guards.clear();
+            std::this_thread::yield();
+        }
+    }
+
+    lockAll(guards);
+    bool found = false;
+    Key best = notFound();
+    for (std::size_t i = shards.size(); i-- > 0;)
+    {
+        const Tree &tree = shards[i]->tree;
+        if (tree.size != 0 && (!found || comp(best, *tree.rbegin())))
+        {
+            best = *tree.rbegin();
+            found = true;
+        }
+    }
+    return best;
+}
+
+// Range mode: the key's own shard answers unless the successor lies in a
+// later shard, which is locked next (ascending, so no deadlock).
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+Key BasicShardedAVL<Key, Compare, Alloc, Hash>::successor(const Key &key) const
+{
+    if (mode == ShardMode::Range)
+    {
+        std::vector<ShardLock> guards(1);
+        std::size_t index = lockShardFor(key, guards[0]);
+        TreeIterator it = shards[index]->tree.upper_bound(key);
+        while (it == shards[index]->tree.end() && index + 1 < shards.size())
+        {
+            index++;
+            guards.push_back(ShardLock(shards[index]->lock));
+            it = shards[index]->tree.begin();
+        }
+        return (it != shards[index]->tree.end()) ? *it : notFound();
+    }
+
+    std::vector<ShardLock> guards;
+    lockAll(guards);
+    bool found = false;
+    Key best = notFound();
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        TreeIterator it = shards[i]->tree.upper_bound(key);
+        if (it != shards[i]->tree.end() && (!found || comp(*it, best)))
+        {
+            best = *it;
+            found = true;
+        }
+    }
+    return best;
+}
+
+// Earlier shards would have to be locked in descending order, so when the
+// key's own shard has no predecessor every shard is locked instead.
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+Key BasicShardedAVL<Key, Compare, Alloc, Hash>::predecessor(const Key &key) const
+{
+    if (mode == ShardMode::Range)
+    {
+        {
+            ShardLock guard;
+            const Tree &tree = shards[lockShardFor(key, guard)]->tree;
+            TreeIterator it = tree.lower_bound(key);
+            if (it != tree.begin())
+            {
+                return *--it;
+            }
+        }
+        std::vector<ShardLock> guards;
+        lockAll(guards);
+        for (std::size_t i = shards.size(); i-- > 0;)
+        {
+            const Tree &tree = shards[i]->tree;
+            TreeIterator it = tree.lower_bound(key);
+            if (it != tree.begin())
+            {
+                return *--it;
+            }
+        }
+        return notFound();
+    }
+
+    std::vector<ShardLock> guards;
+    lockAll(guards);
+    bool found = false;
+    Key best = notFound();
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        TreeIterator it = shards[i]->tree.lower_bound(key);
+        if (it == shards[i]->tree.begin())
+        {
+            continue;
+        }
+        --it;
+        if (!found || comp(best, *it))
+        {
+            best = *it;
+            found = true;
+        }
+    }
+    return best;
+}
+
+template <typename Key, typename Compare, typename Alloc, typename Hash>
+template <typename OutputIt>
+OutputIt BasicShardedAVL<Key, Compare, Alloc, Hash>::rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+{
+    if (comp(k2, k1))
+    {
+        return out;
+    }
+    if (mode == ShardMode::Range)
+    {
+        // The shards from k1's up to the last one starting at or below k2
+        std::vector<ShardLock> guards(1);
+        std::size_t index = lockShardFor(k1, guards[0]);
+        for (;;)
+        {
+            out = shards[index]->tree.rangeSearch(k1, k2, out);
+            if (index + 1 == shards.size() || comp(k2, shards[index + 1]->lower.load()))
+            {
+                return out;
+            }
+            index++;
+            guards.push_back(ShardLock(shards[index]->lock));
+        }
+    }
+
+    // k-way merge of every shard's run, smallest head on top of a heap
+    std::vector<ShardLock> guards;
+    lockAll(guards);
+    typedef std::pair<TreeIterator, TreeIterator> Run;
+    std::vector<Run> runs;
+    for (std::size_t i = 0; i < shards.size(); i++)
+    {
+        Run run(shards[i]->tree.lower_bound(k1), shards[i]->tree.upper_bound(k2));
+        if (run.first != run.second)
+        {
+            runs.push_back(run);
+        }
+    }
+    const Compare &comp = this->comp;
+    auto laterHead = [&comp](const Run &a, const Run &b) { return comp(*b.first, *a.first); };
+    std::make_heap(runs.begin(), runs.end(), laterHead);
+    while (!runs.empty())
+    {
+        std::pop_heap(runs.begin(), runs.end(), laterHead);
+        Run &run = runs.back();
+        *out++ = *run.first;
+        if (++run.first == run.second)
+        {
+            runs.pop_back();
+        }
+        else
+        {
+            std::push_heap(runs.begin(), runs.end(), laterHead);
+        }
+    }
+    return out;
+}
+
+#endif // SHARDEDAVL_H
@@ -0,0 +1,149 @@
+#ifndef SHAREDAVLTREE_H
+#define SHAREDAVLTREE_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "AVLTree.h"
+#include "ReaderWriterLock.h"
+
+// Thread-safe facade over one BasicAVLTree, so many reader threads can
+// share a tree instead of each keeping a copy. Reads take the shared side
+// of a ReaderWriterLock and run concurrently; writes take the exclusive
+// side. Only the tree's const paths are used for reading: the stack-based
+// visit* walks and iterators, never the Morris traversals, which thread
+// links through the nodes, nor the shared result vector. Results go to
+// the caller's output iterator, or come back by value with the usual
+// missing-key sentinel.
+template <typename Key, typename Compare = std::less<Key>, typename Alloc = std::allocator<Key>>
+class BasicSharedAVLTree
+{
+public: // For testing purposes
+    typedef BasicAVLTree<Key, Compare, Alloc> Tree;
+
+    mutable ReaderWriterLock lock;
+    Tree tree;
+
+    static Key notFound() { return avl_detail::missingKey<Key>(std::is_arithmetic<Key>()); }
+
+public:
+    typedef Key key_type;
+    typedef Key value_type;
+    typedef Compare key_compare;
+
+    explicit BasicSharedAVLTree(const Compare &comp = Compare(), const Alloc &alloc = Alloc()) : tree(comp, alloc) {}
+    BasicSharedAVLTree(const BasicSharedAVLTree &) = delete;
+    BasicSharedAVLTree &operator=(const BasicSharedAVLTree &) = delete;
+
+    void insert(const Key &key)
+    {
+        std::lock_guard<ReaderWriterLock> guard(lock);
+        tree.insert(key);
+    }
+
+    void remove(const Key &key)
+    {
+        std::lock_guard<ReaderWriterLock> guard(lock);
+        tree.remove(key);
+    }
+
+    void updateKey(const Key &oldKey, const Key &newKey)
+    {
+        std::lock_guard<ReaderWriterLock> guard(lock);
+        tree.updateKey(oldKey, newKey);
+    }
+
+    void clear()
+    {
+        std::lock_guard<ReaderWriterLock> guard(lock);
+        tree.clear();
+    }
+
+    bool contains(const Key &key) const
+    {
+        SharedLockGuard guard(lock);
+        return tree.contains(key);
+    }
+
+    std::size_t getsize() const
+    {
+        SharedLockGuard guard(lock);
+        return tree.size;
+    }
+
+    Key minimum() const
+    {
+        SharedLockGuard guard(lock);
+        return (tree.size != 0) ? *tree.begin() : notFound();
+    }
+
+    Key maximum() const
+    {
+        SharedLockGuard guard(lock);
+        return (tree.size != 0) ? *tree.rbegin() : notFound();
+    }
+
+    Key successor(const Key &key) const
+    {
+        SharedLockGuard guard(lock);
+        typename Tree::const_iterator it = tree.upper_bound(key);
+        return (it != tree.end()) ? *it : notFound();
+    }
+
+    Key predecessor(const Key &key) const
+    {
+        SharedLockGuard guard(lock);
+        typename Tree::const_iterator it = tree.lower_bound(key);
+        return (it != tree.begin()) ? *--it : notFound();
+    }
+
+    std::size_t rank(const Key &key) const
+    {
+        SharedLockGuard guard(lock);
+        return tree.rank(key);
+    }
+
+    std::size_t countRange(const Key &k1, const Key &k2) const
+    {
+        SharedLockGuard guard(lock);
+        return tree.countRange(k1, k2);
+    }
+
+    template <typename OutputIt>
+    OutputIt inorderTraversal(OutputIt out) const
+    {
+        SharedLockGuard guard(lock);
+        return tree.inorderTraversal(out);
+    }
+
+    template <typename OutputIt>
+    OutputIt rangeSearch(const Key &k1, const Key &k2, OutputIt out) const
+    {
+        SharedLockGuard guard(lock);
+        return tree.rangeSearch(k1, k2, out);
+    }
+
+    // Run fn(const Tree &) under the shared lock, for several reads that
+    // must see the same tree, or fn(Tree &) under the exclusive lock, for
+    // any other update. Returns what fn returns.
+    template <typename Fn>
+    auto read(Fn fn) const -> decltype(fn(std::declval<const Tree &>()))
+    {
+        SharedLockGuard guard(lock);
+        return fn(static_cast<const Tree &>(tree));
+    }
+
+    template <typename Fn>
+    auto write(Fn fn) -> decltype(fn(std::declval<Tree &>()))
+    {
+        std::lock_guard<ReaderWriterLock> guard(lock);
+        return fn(tree);
+    }
+};
+
+typedef BasicSharedAVLTree<int> SharedAVLTree;
+
+#endif // SHAREDAVLTREE_H
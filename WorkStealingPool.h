@@ -0,0 +1,240 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join thread pool with per-worker task deques. A worker pushes forked
+// tasks onto the back of its own deque and pops them back LIFO; idle workers
+// steal from the front of other deques. The thread calling into the pool
+// takes part as worker 0, so a pool of n workers starts n - 1 threads.
+// Tasks must not throw.
+class WorkStealingPool
+{
+public:
+    // workerCount 0 means one worker per hardware thread.
+    explicit WorkStealingPool(unsigned workerCount = 0)
+        : workers(workerCount != 0 ? workerCount : std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned i = 1; i < size(); i++)
+        {
+            threads.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (std::size_t i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+    }
+
+    unsigned size() const
+    {
+        return static_cast<unsigned>(workers.size());
+    }
+
+    // Run fn on the calling thread as worker 0 and wait for every task it forks.
+    template <typename Fn>
+    void run(Fn fn)
+    {
+        WorkerSlot &slot = currentWorker();
+        if (slot.pool == this)
+        {
+            fn();
+            return;
+        }
+        std::lock_guard<std::mutex> guard(entryLock);
+        WorkerSlot saved = slot;
+        slot.pool = this;
+        slot.index = 0;
+        fn();
+        slot = saved;
+    }
+
+    // Run left and right, possibly in parallel, and return when both are done.
+    template <typename Left, typename Right>
+    void invoke(Left left, Right right)
+    {
+        WorkerSlot &slot = currentWorker();
+        if (slot.pool != this)
+        {
+            run([&]() { invoke(left, right); });
+            return;
+        }
+        if (workers.size() == 1)
+        {
+            left();
+            right();
+            return;
+        }
+
+        unsigned self = slot.index;
+        Task task(left);
+        push(self, &task);
+        right();
+
+        if (popOwn(self, &task))
+        {
+            task.fn();
+            return;
+        }
+        // Stolen: help with other work until the thief finishes it
+        while (!task.done.load(std::memory_order_acquire))
+        {
+            Task *other = findTask(self);
+            if (other != nullptr)
+            {
+                execute(other);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Process-wide pool with one worker per hardware thread.
+    static WorkStealingPool &global()
+    {
+        static WorkStealingPool pool;
+        return pool;
+    }
+
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        std::atomic<bool> done;
+
+        template <typename Fn>
+        explicit Task(Fn &fn) : fn(fn), done(false) {}
+    };
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Task *> tasks;
+    };
+
+    struct WorkerSlot
+    {
+        WorkStealingPool *pool;
+        unsigned index;
+    };
+
+    static WorkerSlot &currentWorker()
+    {
+        static thread_local WorkerSlot slot = {nullptr, 0};
+        return slot;
+    }
+
+    void push(unsigned self, Task *task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(workers[self].lock);
+            workers[self].tasks.push_back(task);
+        }
+        pending.fetch_add(1, std::memory_order_release);
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wakeup.notify_one();
+    }
+
+    // Take task back if nobody stole it; forks nested inside it are already done.
+    bool popOwn(unsigned self, Task *task)
+    {
+        std::lock_guard<std::mutex> guard(workers[self].lock);
+        std::deque<Task *> &tasks = workers[self].tasks;
+        if (!tasks.empty() && tasks.back() == task)
+        {
+            tasks.pop_back();
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    Task *findTask(unsigned self)
+    {
+        for (std::size_t i = 0; i < workers.size(); i++)
+        {
+            unsigned victim = static_cast<unsigned>((self + i) % workers.size());
+            std::lock_guard<std::mutex> guard(workers[victim].lock);
+            std::deque<Task *> &tasks = workers[victim].tasks;
+            if (tasks.empty())
+            {
+                continue;
+            }
+            Task *task;
+            if (victim == self)
+            {
+                task = tasks.back();
+                tasks.pop_back();
+            }
+            else
+            {
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+        return nullptr;
+    }
+
+    static void execute(Task *task)
+    {
+        task->fn();
+        task->done.store(true, std::memory_order_release);
+    }
+
+    void workerLoop(unsigned self)
+    {
+        WorkerSlot &slot = currentWorker();
+        slot.pool = this;
+        slot.index = self;
+        for (;;)
+        {
+            Task *task = findTask(self);
+            if (task != nullptr)
+            {
+                execute(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleepLock);
+            if (stopping)
+            {
+                return;
+            }
+            if (pending.load(std::memory_order_acquire) == 0)
+            {
+                wakeup.wait(guard);
+            }
+        }
+    }
+
+    std::vector<Worker> workers;
+    std::vector<std::thread> threads;
+    std::atomic<long> pending{0};
+    std::mutex entryLock;
+    std::mutex sleepLock;
+    std::condition_variable wakeup;
+    bool stopping = false;
+};
+
+#endif // WORKSTEALINGPOOL_H
@@ -0,0 +1,340 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Crc32c.h"
+
+enum class LogOp : std::uint32_t
+{
+    Insert = 1,
+    Remove = 2,
+    UpdateKey = 3
+};
+
+// Append-only log of tree mutations with group commit. Every record has the
+// same width: CRC-32C of the rest of the record, operation, log sequence
+// number (LSN), key and second key (updateKey's new key), in host byte
+// order. append() only encodes the record into an in-memory batch. A
+// background thread writes the batch and fdatasyncs it once it holds
+// groupRecords records or every groupInterval, whichever comes first, so
+// one sync covers many mutations. waitDurable(lsn) blocks until a record
+// is on disk. append() blocks while the unwritten batch is maxPendingBytes
+// or more, so a slow disk holds writers back instead of growing the batch
+// without limit.
+template <typename Key>
+class BasicWriteAheadLog
+{
+public: // For testing purposes
+    int fd;
+    std::mutex lock;
+    std::condition_variable wakeWriter;
+    std::condition_variable wakeWaiters;
+    std::vector<unsigned char> pending; // encoded, not yet written
+    std::size_t pendingRecords = 0;
+    std::uint64_t nextLsn;
+    std::uint64_t durableLsn;
+    bool syncRequested = false;
+    bool stopping = false;
+    std::string failure; // set by the writer thread if a write or sync fails
+    std::chrono::microseconds groupInterval;
+    std::size_t groupRecords;
+    std::thread writer;
+
+    void writerLoop();
+    void checkFailure() const;
+
+public:
+    static const std::size_t recordSize = 16 + 2 * sizeof(Key);
+    static const std::size_t maxPendingBytes = std::size_t(64) << 20;
+
+    // Open (creating if needed) the log at path for appending; the first
+    // record appended gets nextLsn. Throws std::runtime_error on I/O errors.
+    explicit BasicWriteAheadLog(const std::string &path, std::uint64_t nextLsn = 1,
+                                std::chrono::microseconds groupInterval = std::chrono::microseconds(2000),
+                                std::size_t groupRecords = 65536);
+    BasicWriteAheadLog(const BasicWriteAheadLog &) = delete;
+    BasicWriteAheadLog &operator=(const BasicWriteAheadLog &) = delete;
+    // Writes and syncs whatever is still pending.
+    ~BasicWriteAheadLog();
+
+    // Returns the record's LSN.
+    std::uint64_t append(LogOp op, const Key &key, const Key &other = Key());
+
+    // Block until every record up to lsn is durable.
+    void waitDurable(std::uint64_t lsn);
+    void sync() { waitDurable(lastLsn()); }
+
+    std::uint64_t lastLsn();
+
+    // Sync, then drop every record; LSNs keep counting from where they were.
+    void truncate();
+
+    // Call fn(op, lsn, key, other) for each intact record of the log at
+    // path, in order, stopping at the first torn or corrupt record or gap
+    // in the LSNs. Returns the length of the intact prefix in bytes and
+    // sets lastLsn to the last LSN read (left alone if there is none). A
+    // missing file is an empty log.
+    template <typename Fn>
+    static std::size_t replay(const std::string &path, Fn fn, std::uint64_t &lastLsn);
+
+    static void encode(unsigned char *record, LogOp op, std::uint64_t lsn, const Key &key, const Key &other);
+};
+
+typedef BasicWriteAheadLog<int> WriteAheadLog;
+
+template <typename Key>
+const std::size_t BasicWriteAheadLog<Key>::recordSize;
+
+template <typename Key>
+const std::size_t BasicWriteAheadLog<Key>::maxPendingBytes;
+
+template <typename Key>
+BasicWriteAheadLog<Key>::BasicWriteAheadLog(const std::string &path, std::uint64_t nextLsn,
+                                            std::chrono::microseconds groupInterval, std::size_t groupRecords)
+    : nextLsn(nextLsn), durableLsn(nextLsn - 1), groupInterval(groupInterval), groupRecords(groupRecords)
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "log records hold keys as raw bytes");
+
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("WriteAheadLog: cannot open " + path + ": " + std::strerror(errno));
+    }
+    pending.reserve(groupRecords * recordSize);
+    writer = std::thread(&BasicWriteAheadLog::writerLoop, this);
+}
+
+template <typename Key>
+BasicWriteAheadLog<Key>::~BasicWriteAheadLog()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeWriter.notify_one();
+    writer.join();
+    ::close(fd);
+}
+
+template <typename Key>
+void BasicWriteAheadLog<Key>::encode(unsigned char *record, LogOp op, std::uint64_t lsn, const Key &key, const Key &other)
+{
+    std::uint32_t opCode = static_cast<std::uint32_t>(op);
+    std::memcpy(record + 4, &opCode, 4);
+    std::memcpy(record + 8, &lsn, 8);
+    std::memcpy(record + 16, &key, sizeof(Key));
+    std::memcpy(record + 16 + sizeof(Key), &other, sizeof(Key));
+    std::uint32_t checksum = crc32c(record + 4, recordSize - 4);
+    std::memcpy(record, &checksum, 4);
+}
+
+template <typename Key>
+std::uint64_t BasicWriteAheadLog<Key>::append(LogOp op, const Key &key, const Key &other)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (pending.size() >= maxPendingBytes && failure.empty())
+    {
+        wakeWriter.notify_one();
+        wakeWaiters.wait(guard);
+    }
+    checkFailure();
+
+    std::uint64_t lsn = nextLsn++;
+    std::size_t offset = pending.size();
+    pending.resize(offset + recordSize);
+    encode(&pending[offset], op, lsn, key, other);
+    if (++pendingRecords == groupRecords)
+    {
+        wakeWriter.notify_one();
+    }
+    return lsn;
+}
+
+template <typename Key>
+void BasicWriteAheadLog<Key>::waitDurable(std::uint64_t lsn)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    lsn = std::min(lsn, nextLsn - 1);
+    while (durableLsn < lsn && failure.empty())
+    {
+        syncRequested = true;
+        wakeWriter.notify_one();
+        wakeWaiters.wait(guard);
+    }
+    checkFailure();
+}
+
+template <typename Key>
+std::uint64_t BasicWriteAheadLog<Key>::lastLsn()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return nextLsn - 1;
+}
+
+template <typename Key>
+void BasicWriteAheadLog<Key>::truncate()
+{
+    sync();
+    std::lock_guard<std::mutex> guard(lock);
+    if (::ftruncate(fd, 0) != 0 || ::fdatasync(fd) != 0)
+    {
+        throw std::runtime_error(std::string("WriteAheadLog: cannot truncate: ") + std::strerror(errno));
+    }
+}
+
+template <typename Key>
+void BasicWriteAheadLog<Key>::checkFailure() const
+{
+    if (!failure.empty())
+    {
+        throw std::runtime_error("WriteAheadLog: " + failure);
+    }
+}
+
+// One group commit per pass: take the whole pending batch, write and sync
+// it with the lock released, then publish the new durable LSN.
+template <typename Key>
+void BasicWriteAheadLog<Key>::writerLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    std::vector<unsigned char> writing;
+    writing.reserve(pending.capacity());
+    for (;;)
+    {
+        wakeWriter.wait_for(guard, groupInterval, [this]() {
+            return stopping || syncRequested || pendingRecords >= groupRecords || pending.size() >= maxPendingBytes;
+        });
+        if (pending.empty() || !failure.empty())
+        {
+            syncRequested = false;
+            wakeWaiters.notify_all();
+            if (stopping)
+            {
+                return;
+            }
+            continue;
+        }
+
+        writing.swap(pending);
+        pendingRecords = 0;
+        syncRequested = false;
+        std::uint64_t batchLsn = nextLsn - 1;
+        guard.unlock();
+
+        std::string error;
+        for (std::size_t written = 0; written < writing.size();)
+        {
+            ssize_t count = ::write(fd, writing.data() + written, writing.size() - written);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                error = std::string("write failed: ") + std::strerror(errno);
+                break;
+            }
+            written += static_cast<std::size_t>(count);
+        }
+        if (error.empty() && ::fdatasync(fd) != 0)
+        {
+            error = std::string("fdatasync failed: ") + std::strerror(errno);
+        }
+        writing.clear();
+
+        guard.lock();
+        if (error.empty())
+        {
+            durableLsn = batchLsn;
+        }
+        else
+        {
+            failure = error;
+        }
+        wakeWaiters.notify_all();
+    }
+}
+
+template <typename Key>
+template <typename Fn>
+std::size_t BasicWriteAheadLog<Key>::replay(const std::string &path, Fn fn, std::uint64_t &lastLsn)
+{
+    int in = ::open(path.c_str(), O_RDONLY);
+    if (in < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        throw std::runtime_error("WriteAheadLog: cannot open " + path + ": " + std::strerror(errno));
+    }
+
+    std::vector<unsigned char> buffer(4096 * recordSize);
+    std::size_t intact = 0;
+    std::size_t buffered = 0;
+    bool first = true;
+    std::uint64_t previous = 0;
+    for (bool done = false; !done;)
+    {
+        ssize_t count = ::read(in, buffer.data() + buffered, buffer.size() - buffered);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            break;
+        }
+        buffered += static_cast<std::size_t>(count);
+
+        std::size_t offset = 0;
+        for (; buffered - offset >= recordSize; offset += recordSize)
+        {
+            const unsigned char *record = buffer.data() + offset;
+            std::uint32_t checksum;
+            std::uint32_t opCode;
+            std::uint64_t lsn;
+            std::memcpy(&checksum, record, 4);
+            std::memcpy(&opCode, record + 4, 4);
+            std::memcpy(&lsn, record + 8, 8);
+            if (checksum != crc32c(record + 4, recordSize - 4) || opCode < 1 || opCode > 3 || (!first && lsn != previous + 1))
+            {
+                done = true;
+                break;
+            }
+            Key key;
+            Key other;
+            std::memcpy(&key, record + 16, sizeof(Key));
+            std::memcpy(&other, record + 16 + sizeof(Key), sizeof(Key));
+            fn(static_cast<LogOp>(opCode), lsn, key, other);
+            first = false;
+            previous = lsn;
+            intact += recordSize;
+        }
+        buffered -= offset;
+        std::memmove(buffer.data(), buffer.data() + offset, buffered);
+    }
+    ::close(in);
+    if (!first)
+    {
+        lastLsn = previous;
+    }
+    return intact;
+}
+
+#endif // WRITEAHEADLOG_H
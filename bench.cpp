@@ -0,0 +1,911 @@
+#include "AVLTree.h"
+#include "CompactAVLTree.h"
+#include "FrozenSet.h"
+#include "BucketAVLTree.h"
+#include "MappedAVLView.h"
+#include "DurableAVLTree.h"
+#include "PersistentAVLTree.h"
+#include "ConcurrentAVLTree.h"
+#include "ShardedAVL.h"
+#include "SharedAVLTree.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Micro-benchmarks for the AVL trees. Run with the key count as the only argument.
+
+typedef std::chrono::steady_clock benchClock;
+
+static double elapsedMs(benchClock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(benchClock::now() - start).count();
+}
+
+static std::vector<int> randomKeys(std::size_t n, unsigned seed)
+{
+    std::mt19937 gen(seed);
+    std::vector<int> keys(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        keys[i] = static_cast<int>(gen());
+    }
+    return keys;
+}
+
+static void benchBasicOperations(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+    }
+    std::cout << "insert        " << n << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    long long checksum = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    avlTree.inorderTraversal();
+    checksum += avlTree.result->size();
+    avlTree.result->clear();
+    std::cout << "inorder       " << n << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i += 2)
+    {
+        avlTree.remove(keys[i]);
+    }
+    std::cout << "remove        " << n / 2 << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    avlTree.clear();
+    std::cout << "clear                 : " << elapsedMs(start) << " ms" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Pointer nodes against 12-byte index nodes: same keys, same lookups.
+static void benchCompactLayout(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    CompactAVLTree compactTree;
+    compactTree.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+        compactTree.insert(keys[i]);
+    }
+
+    benchClock::time_point start = benchClock::now();
+    std::size_t hits = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        hits += avlTree.contains(probes[i] | 1) + avlTree.contains(keys[i]);
+    }
+    std::cout << "contains      pointer nodes: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        hits += compactTree.contains(probes[i] | 1) + compactTree.contains(keys[i]);
+    }
+    std::cout << "contains      compact nodes: " << elapsedMs(start) << " ms" << std::endl;
+    std::cout << "(hits " << hits << ")" << std::endl;
+}
+
+// Loading a tree by repeated insert against the O(n) bulk build.
+static void benchBulkBuild(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+
+    benchClock::time_point start = benchClock::now();
+    {
+        AVLTree avlTree;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            avlTree.insert(keys[i]);
+        }
+        std::cout << "load by insert      : " << elapsedMs(start) << " ms" << std::endl;
+    }
+
+    start = benchClock::now();
+    AVLTree built;
+    built.buildFromUnsorted(keys.begin(), keys.end());
+    std::cout << "buildFromUnsorted   : " << elapsedMs(start) << " ms" << std::endl;
+
+    std::sort(keys.begin(), keys.end());
+    start = benchClock::now();
+    built.buildFromSorted(keys.begin(), keys.end());
+    std::cout << "buildFromSorted     : " << elapsedMs(start) << " ms" << std::endl;
+}
+
+// Merging a fresh batch into a large tree: per-key insert against unionWith.
+static void benchUnion(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> batch = randomKeys(n / 20, 9);
+
+    AVLTree live;
+    live.buildFromUnsorted(keys.begin(), keys.end());
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < batch.size(); i++)
+    {
+        live.insert(batch[i]);
+    }
+    std::cout << "merge " << batch.size() << " by insert : " << elapsedMs(start) << " ms" << std::endl;
+
+    AVLTree target, batchTree;
+    target.buildFromUnsorted(keys.begin(), keys.end());
+    batchTree.buildFromUnsorted(batch.begin(), batch.end());
+    start = benchClock::now();
+    target.unionWith(batchTree);
+    std::cout << "merge " << batch.size() << " by union  : " << elapsedMs(start) << " ms"
+              << " (size " << target.getsize() << " vs " << live.getsize() << ")" << std::endl;
+}
+
+// mergeFrom two trees of n/2 keys each on 1, 2, 4, ... workers.
+static void benchParallelMerge(std::size_t n)
+{
+    std::vector<int> left = randomKeys(n / 2, 42);
+    std::vector<int> right = randomKeys(n / 2, 43);
+    unsigned maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned workerCount = 1;; workerCount *= 2)
+    {
+        workerCount = std::min(workerCount, maxWorkers);
+        WorkStealingPool workers(workerCount);
+        AVLTree target, source;
+        target.buildFromUnsorted(left.begin(), left.end());
+        source.buildFromUnsorted(right.begin(), right.end());
+
+        benchClock::time_point start = benchClock::now();
+        target.mergeFrom(source, workers);
+        std::cout << "mergeFrom on " << workerCount << " worker(s): " << elapsedMs(start) << " ms"
+                  << " (size " << target.getsize() << ")" << std::endl;
+        if (workerCount == maxWorkers)
+        {
+            break;
+        }
+    }
+}
+
+// Write-heavy churn: fill, then alternate remove and insert.
+static void benchWriteChurn(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    AVLTree avlTree;
+
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+    }
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.remove(keys[i]);
+        avlTree.insert(keys[(i * 7) % n] ^ 1);
+    }
+    double ms = elapsedMs(start);
+    std::cout << "write churn   " << 3 * n << " ops: " << ms << " ms ("
+              << 3 * n / ms / 1000 << " Mops/s)" << std::endl;
+}
+
+// Renaming keys: small in-place moves and far moves that relink the node.
+static void benchUpdateKey(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.updateKey(keys[i], keys[i] ^ 1);
+    }
+    std::cout << "updateKey near " << n << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.updateKey(keys[i] ^ 1, keys[(i * 7) % n] + 3);
+    }
+    std::cout << "updateKey far  " << n << " keys: " << elapsedMs(start) << " ms (size " << avlTree.getsize() << ")" << std::endl;
+}
+
+// Summing the keys in order: filling `result` against visiting in place.
+static void benchTraversal(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    avlTree.inorderTraversal();
+    long long sum = 0;
+    for (std::size_t i = 0; i < avlTree.result->size(); i++)
+    {
+        sum += (*avlTree.result)[i];
+    }
+    avlTree.result->clear();
+    std::cout << "inorder sum   " << avlTree.getsize() << " keys: " << elapsedMs(start) << " ms (result vector)" << std::endl;
+
+    start = benchClock::now();
+    long long visited = 0;
+    avlTree.visitInorder([&visited](int key) { visited += key; });
+    std::cout << "inorder sum   " << avlTree.getsize() << " keys: " << elapsedMs(start) << " ms (visitor)" << std::endl;
+    std::cout << "(checksum " << (sum == visited) << ")" << std::endl;
+}
+
+// "Next 100 keys after x": an iterator page against a full rangeSearch.
+static void benchPagedScan(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(1000, 7);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    long long checksum = 0;
+    for (std::size_t i = 0; i < probes.size(); i++)
+    {
+        AVLTree::const_iterator it = avlTree.lower_bound(probes[i]);
+        for (int taken = 0; taken < 100 && it != avlTree.end(); taken++, ++it)
+        {
+            checksum += *it;
+        }
+    }
+    std::cout << "page of 100   " << probes.size() << " scans: " << elapsedMs(start) << " ms (iterator)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < 10; i++)
+    {
+        avlTree.rangeSearch(probes[i], avlTree.maximum());
+        checksum += avlTree.result->size();
+        avlTree.result->clear();
+    }
+    std::cout << "page of 100   10 scans: " << elapsedMs(start) << " ms (rangeSearch to the end)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Pointer-chasing lookups against the same keys frozen in Eytzinger order.
+static void benchFrozenSet(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    FrozenSet frozen = avlTree.freeze();
+    std::cout << "freeze        " << frozen.size() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    long long checksum = 0;
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.contains(probes[i]);
+    }
+    std::cout << "contains      " << n << " keys: " << elapsedMs(start) << " ms (tree)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += frozen.contains(probes[i]);
+    }
+    std::cout << "contains      " << n << " keys: " << elapsedMs(start) << " ms (frozen)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        FrozenSet::const_iterator bound = frozen.lower_bound(probes[i]);
+        checksum += (bound != frozen.end()) ? *bound : 0;
+    }
+    std::cout << "lower_bound   " << n << " keys: " << elapsedMs(start) << " ms (frozen)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (tree)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += frozen.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (frozen)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Lookups on the insertion-order node layout, then after a van Emde Boas relayout.
+static void benchRelayout(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+    }
+
+    long long checksum = 0;
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (insertion layout)" << std::endl;
+
+    start = benchClock::now();
+    avlTree.relayout();
+    std::cout << "relayout      " << avlTree.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (vEB layout)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// One-key nodes against 32-key buckets searched with each available kernel.
+static void benchBucketTree(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    BucketAVLTree bucketTree;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+        bucketTree.insert(keys[i]);
+    }
+
+    long long checksum = 0;
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.contains(probes[i]) + avlTree.contains(keys[i]);
+    }
+    std::cout << "contains      " << 2 * n << " keys: " << elapsedMs(start) << " ms (AVLTree, height " << avlTree.height() << ")" << std::endl;
+
+    const BucketSearchKernel kernels[] = {BucketSearchKernel::Scalar, BucketSearchKernel::SSE2, BucketSearchKernel::AVX2};
+    const char *names[] = {"scalar", "SSE2", "AVX2"};
+    for (int k = 0; k < 3; k++)
+    {
+        if (!bucketTree.setSearchKernel(kernels[k]))
+        {
+            continue;
+        }
+        start = benchClock::now();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            checksum += bucketTree.contains(probes[i]) + bucketTree.contains(keys[i]);
+        }
+        std::cout << "contains      " << 2 * n << " keys: " << elapsedMs(start) << " ms (buckets, " << names[k] << ", height " << bucketTree.height() << ")" << std::endl;
+    }
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Single dependent descents against batches that overlap their misses.
+static void benchBatchedLookups(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        avlTree.insert(keys[i]);
+    }
+
+    long long checksum = 0;
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.contains(probes[i]);
+    }
+    std::cout << "contains      " << n << " keys: " << elapsedMs(start) << " ms (one at a time)" << std::endl;
+
+    const std::size_t batch = 256;
+    bool found[batch];
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i += batch)
+    {
+        std::size_t count = std::min(batch, n - i);
+        avlTree.containsBatch(probes.data() + i, count, found);
+        checksum += std::count(found, found + count, true);
+    }
+    std::cout << "containsBatch " << n << " keys: " << elapsedMs(start) << " ms (batches of " << batch << ")" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += avlTree.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (one at a time)" << std::endl;
+
+    int next[batch];
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i += batch)
+    {
+        std::size_t count = std::min(batch, n - i);
+        avlTree.successorBatch(probes.data() + i, count, next);
+        for (std::size_t j = 0; j < count; j++)
+        {
+            checksum += next[j];
+        }
+    }
+    std::cout << "successorBatch " << n << " keys: " << elapsedMs(start) << " ms (batches of " << batch << ")" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// Sorted ingest batches of 10k keys: one insert per key against insertBatch,
+// for batches spread over the whole key space and for clustered batches.
+static void benchBatchInsert(std::size_t n)
+{
+    const std::size_t batchSize = 10000;
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> spread = randomKeys(n, 7);
+    std::vector<int> clustered = spread;
+    std::sort(clustered.begin(), clustered.end());
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < n; i += batchSize)
+    {
+        std::sort(spread.begin() + i, spread.begin() + std::min(n, i + batchSize));
+        order.push_back(i);
+    }
+    // Clustered batches are consecutive runs of the sorted keys, in random order
+    std::shuffle(order.begin(), order.end(), std::mt19937(3));
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const char *shape = (pass == 0) ? "spread" : "clustered";
+        std::vector<int> ingest = spread;
+        if (pass == 1)
+        {
+            ingest.clear();
+            for (std::size_t b = 0; b < order.size(); b++)
+            {
+                ingest.insert(ingest.end(), clustered.begin() + order[b], clustered.begin() + std::min(n, order[b] + batchSize));
+            }
+        }
+
+        AVLTree perKey;
+        AVLTree batched;
+        perKey.buildFromUnsorted(keys.begin(), keys.end());
+        batched.buildFromUnsorted(keys.begin(), keys.end());
+
+        benchClock::time_point start = benchClock::now();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            perKey.insert(ingest[i]);
+        }
+        std::cout << "insert        " << n << " keys: " << elapsedMs(start) << " ms (per key, " << shape << ")" << std::endl;
+
+        start = benchClock::now();
+        for (std::size_t i = 0; i < n; i += batchSize)
+        {
+            batched.insertBatch(ingest.begin() + i, ingest.begin() + std::min(n, i + batchSize));
+        }
+        std::cout << "insertBatch   " << n << " keys: " << elapsedMs(start) << " ms (batches of " << batchSize << ", " << shape << ")" << std::endl;
+
+        start = benchClock::now();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            perKey.remove(ingest[i]);
+        }
+        std::cout << "remove        " << n << " keys: " << elapsedMs(start) << " ms (per key, " << shape << ")" << std::endl;
+
+        start = benchClock::now();
+        for (std::size_t i = 0; i < n; i += batchSize)
+        {
+            batched.eraseBatch(ingest.begin() + i, ingest.begin() + std::min(n, i + batchSize));
+        }
+        std::cout << "eraseBatch    " << n << " keys: " << elapsedMs(start) << " ms (batches of " << batchSize << ", " << shape << ")" << std::endl;
+        std::cout << "(sizes " << perKey.getsize() << " " << batched.getsize() << ")" << std::endl;
+    }
+}
+
+static void benchSerialize(std::size_t n)
+{
+    const char *path = "bench.snapshot";
+    std::vector<int> keys = randomKeys(n, 42);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    {
+        std::ofstream out(path, std::ios::binary);
+        avlTree.serialize(out);
+    }
+    std::cout << "serialize     " << avlTree.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    AVLTree reloaded;
+    {
+        std::ifstream in(path, std::ios::binary);
+        reloaded.deserialize_in(in);
+    }
+    std::cout << "deserialize_in " << reloaded.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    // Baseline: the same keys re-inserted one at a time
+    start = benchClock::now();
+    AVLTree perKey;
+    for (AVLTree::const_iterator it = reloaded.begin(); it != reloaded.end(); ++it)
+    {
+        perKey.insert(*it);
+    }
+    std::cout << "insert        " << perKey.getsize() << " keys: " << elapsedMs(start) << " ms (per key reload)" << std::endl;
+
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    std::cout << "(snapshot " << in.tellg() << " bytes)" << std::endl;
+    in.close();
+    std::remove(path);
+}
+
+static void benchMappedView(std::size_t n)
+{
+    const char *path = "bench.image";
+    std::vector<int> keys = randomKeys(n, 42);
+    std::vector<int> probes = randomKeys(n, 7);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    {
+        std::ofstream out(path, std::ios::binary);
+        MappedAVLView::writeImage(out, avlTree);
+    }
+    std::cout << "writeImage    " << avlTree.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = benchClock::now();
+    MappedAVLView view(path);
+    std::cout << "open view     " << view.size() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    long long checksum = 0;
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += view.contains(probes[i]);
+    }
+    std::cout << "contains      " << n << " keys: " << elapsedMs(start) << " ms (mapped, first touch)" << std::endl;
+
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += view.successor(probes[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (mapped)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+    std::remove(path);
+}
+
+static void benchWriteAheadLog(std::size_t n)
+{
+    const char *snapshotPath = "bench.wal.snapshot";
+    const char *logPath = "bench.wal.log";
+    std::vector<int> keys = randomKeys(n, 42);
+    std::remove(snapshotPath);
+    std::remove(logPath);
+
+    {
+        WriteAheadLog log(logPath);
+        benchClock::time_point start = benchClock::now();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            log.append(LogOp::Insert, keys[i]);
+        }
+        log.sync();
+        std::cout << "log append    " << n << " records: " << elapsedMs(start) << " ms (group commit, synced)" << std::endl;
+    }
+    std::remove(logPath);
+
+    {
+        DurableAVLTree durable(snapshotPath, logPath);
+        benchClock::time_point start = benchClock::now();
+        for (std::size_t i = 0; i < n; i++)
+        {
+            durable.insert(keys[i]);
+        }
+        durable.sync();
+        std::cout << "durable insert " << n << " keys: " << elapsedMs(start) << " ms (group commit, synced)" << std::endl;
+    }
+
+    {
+        benchClock::time_point start = benchClock::now();
+        DurableAVLTree recovered(snapshotPath, logPath);
+        std::cout << "replay        " << recovered.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+        // Baseline: waiting for every mutation to be synced before the next
+        const std::size_t synced = std::min<std::size_t>(n, 1000);
+        start = benchClock::now();
+        for (std::size_t i = 0; i < synced; i++)
+        {
+            recovered.waitDurable(recovered.remove(keys[i]));
+        }
+        std::cout << "durable remove " << synced << " keys: " << elapsedMs(start) << " ms (sync per op)" << std::endl;
+    }
+    std::remove(snapshotPath);
+    std::remove(logPath);
+}
+
+// A consistent view for readers: copying the whole tree against an O(1)
+// snapshot of a persistent tree.
+static void benchSnapshots(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    AVLTree avlTree;
+    avlTree.buildFromUnsorted(keys.begin(), keys.end());
+
+    benchClock::time_point start = benchClock::now();
+    AVLTree copy;
+    copy.buildFromSorted(avlTree.begin(), avlTree.end());
+    std::cout << "copy tree     " << copy.getsize() << " keys: " << elapsedMs(start) << " ms" << std::endl;
+
+    PersistentAVLTree persistent;
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        persistent.insert(keys[i]);
+    }
+    std::cout << "insert        " << n << " keys: " << elapsedMs(start) << " ms (persistent)" << std::endl;
+
+    const std::size_t rounds = 1000;
+    std::vector<PersistentAVLTree::Snapshot> snapshots;
+    snapshots.reserve(rounds);
+    start = benchClock::now();
+    for (std::size_t i = 0; i < rounds; i++)
+    {
+        snapshots.push_back(persistent.snapshot());
+        persistent.insert(keys[i] ^ 1);
+    }
+    std::cout << "snapshot      " << rounds << " times: " << elapsedMs(start) << " ms (with one insert each)" << std::endl;
+
+    long long checksum = 0;
+    start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        checksum += snapshots[i % rounds].successor(keys[i]);
+    }
+    std::cout << "successor     " << n << " keys: " << elapsedMs(start) << " ms (snapshots)" << std::endl;
+    std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+// 90% lookups (contains/successor/predecessor), 10% inserts and removes,
+// spread over a growing number of threads sharing one concurrent tree.
+static void benchConcurrent(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    ConcurrentAVLTree tree;
+    benchClock::time_point start = benchClock::now();
+    for (std::size_t i = 0; i < n; i++)
+    {
+        tree.insert(keys[i]);
+    }
+    std::cout << "insert        " << n << " keys: " << elapsedMs(start) << " ms (concurrent, one thread)" << std::endl;
+
+    std::cout << "(" << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    for (unsigned threadCount = 1; threadCount <= 4; threadCount *= 2)
+    {
+        std::vector<long long> checksums(threadCount);
+        std::vector<std::thread> threads;
+        start = benchClock::now();
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            threads.push_back(std::thread([&, t]() {
+                std::mt19937 gen(t + 1);
+                long long checksum = 0;
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    int key = keys[gen() % n];
+                    switch (gen() % 10)
+                    {
+                    case 0:
+                        tree.insert(key ^ 1);
+                        break;
+                    case 1:
+                        tree.remove(key ^ 1);
+                        break;
+                    case 2:
+                    case 3:
+                    case 4:
+                        checksum += tree.successor(key);
+                        break;
+                    case 5:
+                    case 6:
+                        checksum += tree.predecessor(key);
+                        break;
+                    default:
+                        checksum += tree.contains(key);
+                        break;
+                    }
+                }
+                checksums[t] = checksum;
+            }));
+        }
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            threads[t].join();
+        }
+        double ms = elapsedMs(start);
+        std::cout << "90/10 mix     " << threadCount << " x " << n << " ops: " << ms << " ms ("
+                  << threadCount * n / ms / 1000 << " Mops/s, checksum " << checksums[0] << ")" << std::endl;
+    }
+}
+
+// Uniform inserts split over a growing number of threads: one AVLTree
+// behind one mutex against 16 range and 16 hash shards.
+static void benchSharded(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    for (unsigned threadCount = 1; threadCount <= 4; threadCount *= 2)
+    {
+        std::size_t slice = n / threadCount;
+
+        AVLTree single;
+        std::mutex singleLock;
+        benchClock::time_point start = benchClock::now();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            threads.push_back(std::thread([&, t]() {
+                for (std::size_t i = t * slice; i < (t + 1) * slice; i++)
+                {
+                    std::lock_guard<std::mutex> guard(singleLock);
+                    single.insert(keys[i]);
+                }
+            }));
+        }
+        for (unsigned t = 0; t < threadCount; t++)
+        {
+            threads[t].join();
+        }
+        std::cout << "insert        " << threadCount << " threads: " << elapsedMs(start) << " ms (one lock)" << std::endl;
+
+        ShardMode modes[] = {ShardMode::Range, ShardMode::Hash};
+        for (int m = 0; m < 2; m++)
+        {
+            ShardedAVL sharded(16, modes[m]);
+            start = benchClock::now();
+            threads.clear();
+            for (unsigned t = 0; t < threadCount; t++)
+            {
+                threads.push_back(std::thread([&, t]() {
+                    for (std::size_t i = t * slice; i < (t + 1) * slice; i++)
+                    {
+                        sharded.insert(keys[i]);
+                    }
+                }));
+            }
+            for (unsigned t = 0; t < threadCount; t++)
+            {
+                threads[t].join();
+            }
+            std::cout << "insert        " << threadCount << " threads: " << elapsedMs(start) << " ms ("
+                      << (m == 0 ? "range" : "hash") << " shards)" << std::endl;
+        }
+    }
+}
+
+// Readers sharing one tree through SharedAVLTree, each filling its own
+// buffer, against the same reads serialized by a plain mutex; one writer
+// keeps updating meanwhile.
+static void benchSharedReaders(std::size_t n)
+{
+    std::vector<int> keys = randomKeys(n, 42);
+    SharedAVLTree shared;
+    AVLTree plain;
+    std::mutex plainLock;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        shared.insert(keys[i]);
+        plain.insert(keys[i]);
+    }
+
+    const std::size_t readsPerThread = n / 4;
+    for (unsigned threadCount = 1; threadCount <= 4; threadCount *= 2)
+    {
+        for (int locked = 0; locked < 2; locked++)
+        {
+            std::atomic<bool> done(false);
+            std::thread writer([&]() {
+                for (std::size_t i = 0; !done.load(); i = (i + 1) % n)
+                {
+                    if (locked)
+                    {
+                        std::lock_guard<std::mutex> guard(plainLock);
+                        plain.insert(keys[i] ^ 1);
+                    }
+                    else
+                    {
+                        shared.insert(keys[i] ^ 1);
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            });
+            std::vector<long long> checksums(threadCount);
+            std::vector<std::thread> readers;
+            benchClock::time_point start = benchClock::now();
+            for (unsigned t = 0; t < threadCount; t++)
+            {
+                readers.push_back(std::thread([&, t]() {
+                    std::vector<int> buffer;
+                    long long checksum = 0;
+                    for (std::size_t i = t; i < readsPerThread * threadCount; i += threadCount)
+                    {
+                        buffer.clear();
+                        if (locked)
+                        {
+                            std::lock_guard<std::mutex> guard(plainLock);
+                            checksum += plain.contains(keys[i]);
+                            plain.rangeSearch(keys[i], keys[i] + (1 << 16), std::back_inserter(buffer));
+                        }
+                        else
+                        {
+                            checksum += shared.contains(keys[i]);
+                            shared.rangeSearch(keys[i], keys[i] + (1 << 16), std::back_inserter(buffer));
+                        }
+                        checksum += buffer.size();
+                    }
+                    checksums[t] = checksum;
+                }));
+            }
+            for (unsigned t = 0; t < threadCount; t++)
+            {
+                readers[t].join();
+            }
+            double ms = elapsedMs(start);
+            done.store(true);
+            writer.join();
+            std::cout << "shared reads  " << threadCount << " threads: " << ms << " ms ("
+                      << (locked ? "one mutex" : "reader-writer lock") << ", checksum " << checksums[0] << ")" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    benchBasicOperations(n);
+    benchCompactLayout(n);
+    benchBulkBuild(n);
+    benchUnion(n);
+    benchParallelMerge(n);
+    benchWriteChurn(n);
+    benchUpdateKey(n);
+    benchTraversal(n);
+    benchPagedScan(n);
+    benchFrozenSet(n);
+    benchRelayout(n);
+    benchBucketTree(n);
+    benchBatchedLookups(n);
+    benchBatchInsert(n);
+    benchSerialize(n);
+    benchMappedView(n);
+    benchWriteAheadLog(n);
+    benchSnapshots(n);
+    benchConcurrent(n);
+    benchSharded(n);
+    benchSharedReaders(n);
+    return 0;
+}
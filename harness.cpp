@@ -1,7 +1,26 @@
 #include <deepstate/DeepState.hpp>
 #include <vector>
 #include <algorithm> 
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <thread>
+#include <sstream>
+#include <stdexcept>
 #include "AVLTree.h"
+#include "CompactAVLTree.h"
+#include "FrozenSet.h"
+#include "BucketAVLTree.h"
+#include "MappedAVLView.h"
+#include "DurableAVLTree.h"
+#include "PersistentAVLTree.h"
+#include "ConcurrentAVLTree.h"
+#include "ShardedAVL.h"
+#include "SharedAVLTree.h"
 
 using namespace deepstate;
 
@@ -213,3 +232,1554 @@ TEST(AVLTree, ALL)
     //check balance 
     ASSERT(avlTree.isBalanced()) << "Not Balanced";
 }
+
+TEST(AVLTree, GenericKeys)
+{
+    // Descending 64-bit keys: the custom comparator defines the in-order sequence
+    BasicAVLTree<long long, std::greater<long long>> wideTree;
+    const int numValues = DeepState_IntInRange(mininum_int, maximum_int);
+    std::vector<long long> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        long long value = static_cast<long long>(int_gen()) * 4294967296LL + int_gen();
+        wideTree.insert(value);
+        inputValues.push_back(value);
+    }
+
+    std::sort(inputValues.begin(), inputValues.end(), std::greater<long long>());
+    inputValues.erase(std::unique(inputValues.begin(), inputValues.end()), inputValues.end());
+
+    wideTree.inorderTraversal();
+    ASSERT(*wideTree.result == inputValues) << "Comparator order not respected";
+    ASSERT(wideTree.getsize() == inputValues.size()) << "Wide tree size is incorrect";
+    ASSERT(wideTree.minimum() == inputValues.front()) << "Wide tree minimum is incorrect";
+    ASSERT(wideTree.isBalanced()) << "Wide tree not balanced";
+
+    // String keys
+    BasicAVLTree<std::string> stringTree;
+    for (int i = 0; i < numValues; ++i)
+    {
+        stringTree.insert(std::to_string(int_gen()));
+    }
+    stringTree.inorderTraversal();
+    ASSERT(std::is_sorted(stringTree.result->begin(), stringTree.result->end())) << "String tree not sorted";
+    ASSERT(stringTree.successor(stringTree.maximum()).empty()) << "Missing string successor should be empty";
+}
+
+TEST(AVLTree, OrderedLookup)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(mininum_int, maximum_int);
+    std::vector<int> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-50, 50);
+        avlTree.insert(value);
+        inputValues.push_back(value);
+    }
+    std::sort(inputValues.begin(), inputValues.end());
+
+    for (int key = -52; key <= 52; key++)
+    {
+        bool expected = std::binary_search(inputValues.begin(), inputValues.end(), key);
+        ASSERT(avlTree.contains(key) == expected) << "contains(" << key << ") is incorrect";
+        ASSERT(avlTree.contains(key) == avlTree.depthFirstSearch(key)) << "contains disagrees with DFS";
+        ASSERT(expected == (avlTree.find(key) != nullptr && avlTree.find(key)->data == key)) << "find is incorrect";
+
+        std::vector<int>::iterator lower = std::lower_bound(inputValues.begin(), inputValues.end(), key);
+        std::vector<int>::iterator upper = std::upper_bound(inputValues.begin(), inputValues.end(), key);
+        AVLTree::const_iterator lowerIt = avlTree.lower_bound(key);
+        AVLTree::const_iterator upperIt = avlTree.upper_bound(key);
+        ASSERT((lowerIt == avlTree.end()) == (lower == inputValues.end())) << "lower_bound is incorrect";
+        ASSERT(lowerIt == avlTree.end() || *lowerIt == *lower) << "lower_bound is incorrect";
+        ASSERT((upperIt == avlTree.end()) == (upper == inputValues.end())) << "upper_bound is incorrect";
+        ASSERT(upperIt == avlTree.end() || *upperIt == *upper) << "upper_bound is incorrect";
+    }
+}
+
+TEST(AVLTree, NodePool)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(mininum_int, maximum_int);
+    std::vector<int> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = int_gen();
+        avlTree.insert(value);
+        inputValues.push_back(value);
+    }
+
+    NodePoolStats stats = avlTree.poolStats();
+    ASSERT(stats.liveNodes == avlTree.getsize()) << "Live node count is incorrect";
+    ASSERT(stats.slabs >= 1 && stats.capacity >= stats.liveNodes) << "Slab accounting is incorrect";
+
+    // Removed nodes go to the free list and are handed out again first
+    avlTree.remove(inputValues[0]);
+    stats = avlTree.poolStats();
+    ASSERT(stats.freeNodes == 1 && stats.liveNodes == avlTree.getsize()) << "Removed node not recycled";
+    avlTree.insert(inputValues[0]);
+    ASSERT(avlTree.poolStats().freeNodes == 0) << "Free list not reused";
+
+    // Slab mode keeps its slabs across clear()
+    std::size_t slabs = avlTree.poolStats().slabs;
+    avlTree.clear();
+    stats = avlTree.poolStats();
+    ASSERT(stats.liveNodes == 0 && stats.slabs == slabs && avlTree.getsize() == 0) << "Slab clear is incorrect";
+
+    // Arena mode hands the slabs back in bulk
+    avlTree.setPoolMode(NodePoolMode::Arena);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(inputValues[i]);
+    }
+    avlTree.remove(inputValues[0]);
+    ASSERT(avlTree.poolStats().freeNodes == 0) << "Arena mode should not recycle nodes";
+    avlTree.clear();
+    ASSERT(avlTree.poolStats().slabs == 0 && avlTree.count() == 0) << "Arena clear kept slabs";
+
+    // Keys with destructors are still destroyed one by one
+    BasicAVLTree<std::string> stringTree(std::less<std::string>(), std::allocator<std::string>(), NodePoolMode::Arena);
+    for (int i = 0; i < numValues; ++i)
+    {
+        stringTree.insert(std::string(64, 'k') + std::to_string(inputValues[i]));
+    }
+    stringTree.clear();
+    ASSERT(stringTree.poolStats().liveNodes == 0 && stringTree.getsize() == 0) << "String arena clear failed";
+}
+
+TEST(CompactAVLTree, MatchesAVLTree)
+{
+    AVLTree avlTree;
+    CompactAVLTree compactTree;
+    const int numValues = DeepState_IntInRange(mininum_int, 100);
+    std::vector<int> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-200, 200);
+        avlTree.insert(value);
+        compactTree.insert(value);
+        inputValues.push_back(value);
+    }
+    for (int i = 0; i < numValues / 2; ++i)
+    {
+        int value = (i % 2) ? inputValues[DeepState_IntInRange(0, numValues - 1)] : DeepState_IntInRange(-200, 200);
+        avlTree.remove(value);
+        compactTree.remove(value);
+    }
+
+    ASSERT(compactTree.getsize() == avlTree.getsize() && compactTree.count() == avlTree.count()) << "Compact size differs";
+    ASSERT(compactTree.isBalanced()) << "Compact tree not balanced";
+
+    // Same rotations, so even the shape must match
+    avlTree.preorderTraversal();
+    compactTree.preorderTraversal();
+    ASSERT(*avlTree.result == *compactTree.result) << "Compact preorder differs";
+    avlTree.result->clear();
+    compactTree.result->clear();
+
+    avlTree.levelOrderTraversal();
+    compactTree.levelOrderTraversal();
+    ASSERT(*avlTree.result == *compactTree.result) << "Compact level order differs";
+    avlTree.result->clear();
+    compactTree.result->clear();
+
+    ASSERT(compactTree.height() == avlTree.height()) << "Compact height differs";
+    ASSERT(compactTree.minimum() == avlTree.minimum() && compactTree.maximum() == avlTree.maximum()) << "Compact min/max differs";
+
+    for (int key = -202; key <= 202; key += 3)
+    {
+        ASSERT(compactTree.contains(key) == avlTree.contains(key)) << "Compact contains differs";
+        ASSERT(compactTree.successor(key) == avlTree.successor(key)) << "Compact successor differs";
+        ASSERT(compactTree.predecessor(key) == avlTree.predecessor(key)) << "Compact predecessor differs";
+    }
+
+    compactTree.rangeSearch(-50, 50);
+    avlTree.rangeSearch(-50, 50);
+    ASSERT(*avlTree.result == *compactTree.result) << "Compact range search differs";
+
+    compactTree.clear();
+    ASSERT(compactTree.getsize() == 0 && compactTree.count() == 0 && compactTree.minimum() == -1) << "Compact clear failed";
+}
+
+TEST(AVLTree, BulkBuild)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 200);
+    std::vector<int> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        inputValues.push_back(DeepState_IntInRange(-100, 100));
+    }
+    avlTree.insert(12345); // replaced by the build
+
+    avlTree.buildFromUnsorted(inputValues.begin(), inputValues.end());
+
+    std::sort(inputValues.begin(), inputValues.end());
+    inputValues.erase(std::unique(inputValues.begin(), inputValues.end()), inputValues.end());
+
+    ASSERT(avlTree.getsize() == inputValues.size() && avlTree.count() == (int)inputValues.size()) << "Bulk build size is incorrect";
+    ASSERT(avlTree.isBalanced()) << "Bulk build not balanced";
+    ASSERT(!avlTree.contains(12345)) << "Bulk build kept old contents";
+    avlTree.inorderTraversal();
+    ASSERT(*avlTree.result == inputValues) << "Bulk build inorder is incorrect";
+    avlTree.result->clear();
+
+    // Perfectly balanced: height is floor(log2 n) + 1
+    int expectedHeight = 0;
+    for (std::size_t n = inputValues.size(); n > 0; n >>= 1)
+    {
+        expectedHeight++;
+    }
+    ASSERT(avlTree.height() == expectedHeight) << "Bulk build height is incorrect";
+
+    // The built tree keeps working with the ordinary mutators
+    avlTree.insert(1000);
+    avlTree.remove(inputValues.empty() ? 0 : inputValues[0]);
+    ASSERT(avlTree.isBalanced() && avlTree.contains(1000)) << "Mutating a bulk built tree failed";
+    ASSERT(avlTree.poolStats().liveNodes == avlTree.getsize()) << "Bulk build pool accounting is incorrect";
+
+    // Sorted input with repeats
+    std::vector<int> repeated;
+    for (int i = 0; i < numValues; ++i)
+    {
+        repeated.push_back(i / 3);
+    }
+    avlTree.buildFromSorted(repeated.begin(), repeated.end());
+    ASSERT(avlTree.getsize() == static_cast<std::size_t>((numValues + 2) / 3)) << "Sorted build kept duplicates";
+    ASSERT(avlTree.isBalanced()) << "Sorted build not balanced";
+
+    // Rebuilding over and over holds on to no more than the latest block
+    for (int i = 0; i < 5; i++)
+    {
+        avlTree.buildFromSorted(repeated.begin(), repeated.end());
+    }
+    NodePoolStats stats = avlTree.poolStats();
+    ASSERT(stats.slabs <= 1 && stats.capacity == avlTree.getsize()) << "Repeated bulk builds kept idle slabs";
+}
+
+// Recomputes every height and subtree size and checks them against the stored ones; -1 on mismatch.
+static int verifiedHeight(AVLTree::Node *node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+    int left = verifiedHeight(node->left);
+    int right = verifiedHeight(node->right);
+    std::size_t subtreeSize = 1 + (node->left ? node->left->subtreeSize : 0) + (node->right ? node->right->subtreeSize : 0);
+    if (left < 0 || right < 0 || left - right > 1 || right - left > 1 || node->height != 1 + std::max(left, right) ||
+        node->subtreeSize != subtreeSize)
+    {
+        return -1;
+    }
+    return node->height;
+}
+
+static std::vector<int> randomSortedSet(int count, int range)
+{
+    std::vector<int> values;
+    for (int i = 0; i < count; ++i)
+    {
+        values.push_back(DeepState_IntInRange(-range, range));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+TEST(AVLTree, SetOperations)
+{
+    const int range = DeepState_IntInRange(1, 300);
+    std::vector<int> a = randomSortedSet(DeepState_IntInRange(0, 200), range);
+    std::vector<int> b = randomSortedSet(DeepState_IntInRange(0, 200), range);
+
+    for (int op = 0; op < 3; ++op)
+    {
+        AVLTree treeA, treeB;
+        // Mix bulk-built and incrementally built shapes
+        treeA.buildFromSorted(a.begin(), a.end());
+        for (std::size_t i = 0; i < b.size(); ++i)
+        {
+            treeB.insert(b[i]);
+        }
+
+        std::vector<int> expected;
+        if (op == 0)
+        {
+            treeA.unionWith(treeB);
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        else if (op == 1)
+        {
+            treeA.intersectWith(treeB);
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        else
+        {
+            treeA.differenceWith(treeB);
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+
+        treeA.inorderTraversal();
+        ASSERT(*treeA.result == expected) << "Set operation " << op << " produced the wrong keys";
+        ASSERT(treeA.getsize() == expected.size()) << "Set operation " << op << " size is incorrect";
+        ASSERT(verifiedHeight(treeA.root) >= 0) << "Set operation " << op << " broke the AVL invariant";
+        ASSERT(treeB.getsize() == 0 && treeB.root == nullptr) << "Set operation " << op << " left the argument non-empty";
+        ASSERT(treeA.poolStats().liveNodes == expected.size()) << "Set operation " << op << " leaked nodes";
+
+        // Both trees stay usable
+        treeA.insert(range + 1);
+        treeB.insert(range + 1);
+        ASSERT(treeA.contains(range + 1) && treeB.getsize() == 1) << "Trees unusable after set operation";
+    }
+}
+
+TEST(AVLTree, ParallelSetOperations)
+{
+    // A tiny grain forces forking at almost every level
+    static WorkStealingPool workers(4);
+    const int range = DeepState_IntInRange(1, 2000);
+    const std::size_t grainSize = DeepState_IntInRange(1, 64);
+    std::vector<int> a = randomSortedSet(DeepState_IntInRange(0, 1000), range);
+    std::vector<int> b = randomSortedSet(DeepState_IntInRange(0, 1000), range);
+
+    for (int op = 0; op < 3; ++op)
+    {
+        AVLTree treeA, treeB;
+        treeA.buildFromSorted(a.begin(), a.end());
+        treeB.buildFromSorted(b.begin(), b.end());
+
+        std::vector<int> expected;
+        if (op == 0)
+        {
+            treeA.mergeFrom(treeB, workers, grainSize);
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        else if (op == 1)
+        {
+            treeA.parallelIntersectWith(treeB, workers, grainSize);
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+        else
+        {
+            treeA.parallelDifferenceWith(treeB, workers, grainSize);
+            std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        }
+
+        treeA.inorderTraversal();
+        ASSERT(*treeA.result == expected) << "Parallel set operation " << op << " produced the wrong keys";
+        ASSERT(treeA.getsize() == expected.size() && treeA.isBalanced()) << "Parallel set operation " << op << " broke the tree";
+        ASSERT(verifiedHeight(treeA.root) >= 0) << "Parallel set operation " << op << " has stale heights";
+        ASSERT(treeA.poolStats().liveNodes == expected.size()) << "Parallel set operation " << op << " leaked nodes";
+    }
+}
+
+TEST(AVLTree, OrderStatistics)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 200);
+    std::vector<int> inputValues;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-100, 100);
+        avlTree.insert(value);
+        inputValues.push_back(value);
+    }
+    for (int i = 0; i < numValues / 3; ++i)
+    {
+        avlTree.remove(DeepState_IntInRange(-100, 100));
+    }
+    ASSERT(verifiedHeight(avlTree.root) >= 0) << "Subtree sizes out of date";
+
+    avlTree.inorderTraversal();
+    std::vector<int> keys = *avlTree.result;
+    avlTree.result->clear();
+    ASSERT(avlTree.root == nullptr || avlTree.root->subtreeSize == keys.size()) << "Root subtree size is incorrect";
+
+    for (std::size_t i = 0; i <= keys.size(); ++i)
+    {
+        ASSERT(avlTree.select(i) == (i < keys.size() ? keys[i] : -1)) << "select(" << i << ") is incorrect";
+    }
+    for (int key = -102; key <= 102; ++key)
+    {
+        std::size_t expectedRank = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        ASSERT(avlTree.rank(key) == expectedRank) << "rank(" << key << ") is incorrect";
+    }
+
+    int k1 = DeepState_IntInRange(-110, 110);
+    int k2 = DeepState_IntInRange(-110, 110);
+    avlTree.rangeSearch(k1, k2);
+    ASSERT(avlTree.countRange(k1, k2) == avlTree.result->size()) << "countRange disagrees with rangeSearch";
+    avlTree.result->clear();
+
+    if (keys.empty())
+    {
+        ASSERT(avlTree.median() == -1 && avlTree.percentile(50) == -1) << "Empty tree has a median";
+    }
+    else
+    {
+        ASSERT(avlTree.median() == keys[(keys.size() - 1) / 2]) << "median is incorrect";
+        ASSERT(avlTree.percentile(0) == keys.front() && avlTree.percentile(100) == keys.back()) << "Extreme percentiles are incorrect";
+        std::size_t p99Rank = static_cast<std::size_t>(std::ceil(0.99 * keys.size()));
+        ASSERT(avlTree.percentile(99) == keys[p99Rank - 1]) << "p99 is incorrect";
+    }
+
+    // Bulk build and set operations keep sizes too
+    AVLTree other;
+    other.buildFromUnsorted(inputValues.begin(), inputValues.end());
+    ASSERT(verifiedHeight(other.root) >= 0) << "Bulk build sizes are incorrect";
+    avlTree.unionWith(other);
+    ASSERT(verifiedHeight(avlTree.root) >= 0) << "Union sizes are incorrect";
+}
+
+TEST(AVLTree, WriteChurn)
+{
+    AVLTree avlTree;
+    std::set<int> reference;
+    const int numOps = DeepState_IntInRange(1, 400);
+    const int range = DeepState_IntInRange(1, 100);
+
+    for (int i = 0; i < numOps; ++i)
+    {
+        int value = DeepState_IntInRange(-range, range);
+        if (DeepState_Bool())
+        {
+            avlTree.insert(value);
+            reference.insert(value);
+        }
+        else
+        {
+            avlTree.remove(value);
+            reference.erase(value);
+        }
+    }
+
+    ASSERT(avlTree.getsize() == reference.size() && avlTree.count() == (int)reference.size()) << "Churn size is incorrect";
+    ASSERT(verifiedHeight(avlTree.root) >= 0) << "Churn broke heights, sizes or balance";
+    avlTree.inorderTraversal();
+    ASSERT(std::equal(reference.begin(), reference.end(), avlTree.result->begin()) && avlTree.result->size() == reference.size()) << "Churn keys are incorrect";
+}
+
+TEST(AVLTree, UpdateKey)
+{
+    AVLTree avlTree;
+    std::set<int> reference;
+    const int numValues = DeepState_IntInRange(0, 200);
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-300, 300);
+        avlTree.insert(value);
+        reference.insert(value);
+    }
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        int oldKey = DeepState_IntInRange(-300, 300);
+        // Mostly small moves that stay between the neighbours, sometimes far jumps
+        int newKey = DeepState_Bool() ? oldKey + DeepState_IntInRange(-2, 2) : DeepState_IntInRange(-300, 300);
+        NodePoolStats before = avlTree.poolStats();
+
+        avlTree.updateKey(oldKey, newKey);
+        if (reference.erase(oldKey))
+        {
+            reference.insert(newKey);
+        }
+
+        NodePoolStats after = avlTree.poolStats();
+        ASSERT(after.capacity == before.capacity && after.liveNodes == avlTree.getsize()) << "updateKey allocated a node";
+        ASSERT(avlTree.getsize() == reference.size()) << "updateKey size is incorrect";
+    }
+
+    ASSERT(verifiedHeight(avlTree.root) >= 0) << "updateKey broke the AVL invariant";
+    avlTree.inorderTraversal();
+    ASSERT(std::equal(reference.begin(), reference.end(), avlTree.result->begin()) && avlTree.result->size() == reference.size()) << "updateKey broke the ordering";
+}
+
+TEST(AVLTree, VisitorTraversals)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 200);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-500, 500));
+    }
+
+    // Each output-iterator overload matches the result-vector traversal
+    std::vector<int> streamed;
+    avlTree.inorderTraversal(std::back_inserter(streamed));
+    avlTree.inorderTraversal();
+    ASSERT(streamed == *avlTree.result) << "Streamed inorder differs";
+    avlTree.result->clear();
+    streamed.clear();
+
+    avlTree.preorderTraversal(std::back_inserter(streamed));
+    avlTree.preorderTraversal();
+    ASSERT(streamed == *avlTree.result) << "Streamed preorder differs";
+    avlTree.result->clear();
+    streamed.clear();
+
+    avlTree.postorderTraversal(std::back_inserter(streamed));
+    avlTree.postorderTraversal();
+    ASSERT(streamed == *avlTree.result) << "Streamed postorder differs";
+    avlTree.result->clear();
+    streamed.clear();
+
+    avlTree.levelOrderTraversal(std::back_inserter(streamed));
+    avlTree.levelOrderTraversal();
+    ASSERT(streamed == *avlTree.result) << "Streamed level order differs";
+    avlTree.result->clear();
+    streamed.clear();
+
+    int k1 = DeepState_IntInRange(-600, 600);
+    int k2 = DeepState_IntInRange(-600, 600);
+    std::vector<int> buffer(avlTree.getsize());
+    std::vector<int>::iterator end = avlTree.rangeSearch(k1, k2, buffer.begin());
+    avlTree.rangeSearch(k1, k2);
+    ASSERT(std::equal(buffer.begin(), end, avlTree.result->begin()) && (std::size_t)(end - buffer.begin()) == avlTree.result->size()) << "Streamed range search differs";
+    avlTree.result->clear();
+
+    // Void visitor sees every key
+    long long sum = 0;
+    ASSERT(avlTree.visitInorder([&sum](int key) { sum += key; })) << "Void visitor stopped early";
+    long long expected = 0;
+    avlTree.inorderTraversal();
+    for (std::size_t i = 0; i < avlTree.result->size(); i++)
+    {
+        expected += (*avlTree.result)[i];
+    }
+    ASSERT(sum == expected) << "Visitor sum is incorrect";
+
+    // Returning false stops after exactly `limit` keys, in every order
+    std::size_t limit = DeepState_IntInRange(0, numValues);
+    std::size_t seen = 0;
+    std::vector<int> firstKeys;
+    bool completed = avlTree.visitInorder([&](int key) {
+        if (seen == limit)
+        {
+            return false;
+        }
+        seen++;
+        firstKeys.push_back(key);
+        return true;
+    });
+    ASSERT(completed == (limit >= avlTree.getsize())) << "Early exit reported incorrectly";
+    ASSERT(std::equal(firstKeys.begin(), firstKeys.end(), avlTree.result->begin())) << "Early exit visited the wrong keys";
+    avlTree.result->clear();
+
+    seen = 0;
+    avlTree.visitLevelOrder([&](int) { return ++seen < limit; });
+    ASSERT(seen == std::min<std::size_t>(std::max<std::size_t>(limit, 1), avlTree.getsize())) << "Level order early exit is incorrect";
+}
+
+TEST(AVLTree, Iterators)
+{
+    AVLTree avlTree;
+    std::set<int> expected;
+    const int numValues = DeepState_IntInRange(0, 200);
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-500, 500);
+        avlTree.insert(value);
+        expected.insert(value);
+    }
+
+    std::vector<int> forward;
+    for (int key : avlTree)
+    {
+        forward.push_back(key);
+    }
+    ASSERT(std::equal(forward.begin(), forward.end(), expected.begin()) && forward.size() == expected.size()) << "Forward iteration is incorrect";
+    ASSERT((std::size_t)std::distance(avlTree.begin(), avlTree.end()) == avlTree.getsize()) << "Iterator distance is incorrect";
+    ASSERT(std::equal(avlTree.rbegin(), avlTree.rend(), expected.rbegin())) << "Reverse iteration is incorrect";
+
+    if (!expected.empty())
+    {
+        ASSERT(*--avlTree.end() == *expected.rbegin()) << "Decrementing end() is incorrect";
+        ASSERT(std::find(avlTree.begin(), avlTree.end(), *expected.begin()) == avlTree.begin()) << "std::find is incorrect";
+    }
+
+    // A page of keys from a bound matches the std::set page, both ways
+    int key = DeepState_IntInRange(-600, 600);
+    int pageSize = DeepState_IntInRange(1, 20);
+    AVLTree::const_iterator it = avlTree.lower_bound(key);
+    std::set<int>::const_iterator setIt = expected.lower_bound(key);
+    for (int i = 0; i < pageSize && setIt != expected.end(); i++, ++it, ++setIt)
+    {
+        ASSERT(it != avlTree.end() && *it == *setIt) << "Paged scan is incorrect";
+    }
+    ASSERT((it == avlTree.end()) == (setIt == expected.end())) << "Paged scan ended incorrectly";
+
+    it = avlTree.upper_bound(key);
+    setIt = expected.upper_bound(key);
+    for (int i = 0; i < pageSize && setIt != expected.begin(); i++)
+    {
+        --it;
+        --setIt;
+        ASSERT(*it == *setIt) << "Backward paged scan is incorrect";
+    }
+}
+
+TEST(AVLTree, IterativeTraversals)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-1000, 1000));
+    }
+
+    // Morris walks thread and unthread right links; the shape must survive
+    std::vector<int> shapeBefore;
+    avlTree.preorderTraversal(std::back_inserter(shapeBefore));
+    avlTree.inorderTraversal();
+    avlTree.preorderTraversal();
+    avlTree.result->clear();
+    std::vector<int> shapeAfter;
+    avlTree.preorderTraversal(std::back_inserter(shapeAfter));
+    ASSERT(shapeBefore == shapeAfter) << "Morris traversal changed the tree";
+    ASSERT(verifiedHeight(avlTree.root) != -1) << "Morris traversal broke heights or sizes";
+
+    ASSERT(avlTree.count() == (int)avlTree.getsize()) << "count is incorrect";
+    ASSERT(avlTree.isBalanced()) << "isBalanced is incorrect";
+    for (int i = 0; i < 20; i++)
+    {
+        int key = DeepState_IntInRange(-1100, 1100);
+        ASSERT(avlTree.depthFirstSearch(key) == avlTree.contains(key)) << "DFS is incorrect";
+        ASSERT(avlTree.breadthFirstSearch(key) == avlTree.contains(key)) << "BFS is incorrect";
+    }
+
+    // The level-order buffer is reused, including after the tree grows
+    std::vector<int> levels;
+    avlTree.levelOrderTraversal(std::back_inserter(levels));
+    for (int i = 0; i < 2; i++)
+    {
+        avlTree.levelOrderTraversal();
+        ASSERT(*avlTree.result == levels) << "Level order is incorrect";
+        avlTree.result->clear();
+    }
+    avlTree.insert(2000);
+    levels.clear();
+    avlTree.levelOrderTraversal(std::back_inserter(levels));
+    avlTree.levelOrderTraversal();
+    ASSERT(*avlTree.result == levels) << "Level order after growth is incorrect";
+    avlTree.result->clear();
+
+    // clear(Node *) runs only for keys that need destroying
+    BasicAVLTree<std::string> stringTree;
+    for (int i = 0; i < numValues; i++)
+    {
+        stringTree.insert(std::string(DeepState_IntInRange(1, 40), 'a' + i % 26) + std::to_string(i));
+    }
+    stringTree.clear();
+    ASSERT(stringTree.getsize() == 0 && stringTree.poolStats().liveNodes == 0) << "clear left nodes behind";
+    stringTree.insert("reused");
+    ASSERT(stringTree.count() == 1) << "Tree unusable after clear";
+}
+
+TEST(FrozenSet, MatchesAVLTree)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-1000, 1000));
+    }
+    FrozenSet frozen = avlTree.freeze();
+
+    ASSERT(frozen.size() == avlTree.getsize()) << "Frozen size is incorrect";
+    ASSERT(std::equal(frozen.begin(), frozen.end(), avlTree.begin()) && std::equal(avlTree.begin(), avlTree.end(), frozen.begin())) << "Frozen iteration is incorrect";
+    ASSERT(frozen.minimum() == avlTree.minimum() && frozen.maximum() == avlTree.maximum()) << "Frozen min/max is incorrect";
+    if (!frozen.empty())
+    {
+        ASSERT(*--frozen.end() == avlTree.maximum()) << "Decrementing end() is incorrect";
+        // Node 1 one key past a line boundary, so descendants share lines
+        ASSERT((reinterpret_cast<std::uintptr_t>(frozen.keys.data()) - sizeof(int)) % 64 == 0) << "Frozen keys are not line-offset";
+    }
+
+    for (int i = 0; i < 50; i++)
+    {
+        int key = DeepState_IntInRange(-1100, 1100);
+        ASSERT(frozen.contains(key) == avlTree.contains(key)) << "Frozen contains(" << key << ") is incorrect";
+        ASSERT(frozen.successor(key) == avlTree.successor(key)) << "Frozen successor(" << key << ") is incorrect";
+        ASSERT(frozen.predecessor(key) == avlTree.predecessor(key)) << "Frozen predecessor(" << key << ") is incorrect";
+
+        FrozenSet::const_iterator lower = frozen.lower_bound(key);
+        AVLTree::const_iterator treeLower = avlTree.lower_bound(key);
+        ASSERT((lower == frozen.end()) == (treeLower == avlTree.end()) && (lower == frozen.end() || *lower == *treeLower)) << "Frozen lower_bound is incorrect";
+        FrozenSet::const_iterator upper = frozen.upper_bound(key);
+        AVLTree::const_iterator treeUpper = avlTree.upper_bound(key);
+        ASSERT((upper == frozen.end()) == (treeUpper == avlTree.end()) && (upper == frozen.end() || *upper == *treeUpper)) << "Frozen upper_bound is incorrect";
+        if (lower != frozen.begin())
+        {
+            ASSERT(*--lower == avlTree.predecessor(key)) << "Frozen iterator decrement is incorrect";
+        }
+
+        int k2 = DeepState_IntInRange(-1100, 1100);
+        std::vector<int> frozenRange;
+        std::vector<int> treeRange;
+        frozen.rangeSearch(key, k2, std::back_inserter(frozenRange));
+        avlTree.rangeSearch(key, k2, std::back_inserter(treeRange));
+        ASSERT(frozenRange == treeRange) << "Frozen rangeSearch is incorrect";
+    }
+
+    // The snapshot does not follow later writes
+    avlTree.insert(5000);
+    ASSERT(!frozen.contains(5000) && frozen.size() + 1 >= avlTree.getsize()) << "Frozen set changed with the tree";
+}
+
+static bool nodesWithin(AVLTree::Node *node, AVLTree::Node *first, AVLTree::Node *last)
+{
+    if (node == nullptr)
+    {
+        return true;
+    }
+    return node >= first && node < last && nodesWithin(node->left, first, last) && nodesWithin(node->right, first, last);
+}
+
+TEST(AVLTree, Relayout)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-1000, 1000));
+    }
+    std::vector<int> shapeBefore;
+    avlTree.preorderTraversal(std::back_inserter(shapeBefore));
+
+    // Same tree, now in a single block with the root first
+    avlTree.relayout();
+    std::vector<int> shapeAfter;
+    avlTree.preorderTraversal(std::back_inserter(shapeAfter));
+    ASSERT(shapeBefore == shapeAfter) << "Relayout changed the tree";
+    ASSERT(verifiedHeight(avlTree.root) != -1) << "Relayout broke heights or sizes";
+    NodePoolStats stats = avlTree.poolStats();
+    ASSERT(stats.liveNodes == avlTree.getsize() && stats.freeNodes == 0) << "Relayout pool accounting is incorrect";
+    ASSERT(avlTree.getsize() == 0 || (stats.slabs == 1 && nodesWithin(avlTree.root, avlTree.root, avlTree.root + avlTree.getsize()))) << "Relayout did not pack the nodes";
+
+    // Automatic relayout keeps the tree correct through further writes
+    std::set<int> expected(shapeBefore.begin(), shapeBefore.end());
+    avlTree.setRelayoutInterval(DeepState_IntInRange(1, 50));
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-1000, 1000);
+        if (DeepState_Bool())
+        {
+            avlTree.insert(value);
+            expected.insert(value);
+        }
+        else
+        {
+            avlTree.remove(value);
+            expected.erase(value);
+        }
+    }
+    ASSERT(verifiedHeight(avlTree.root) != -1) << "Tree unbalanced after automatic relayouts";
+    ASSERT(std::equal(avlTree.begin(), avlTree.end(), expected.begin()) && avlTree.getsize() == expected.size()) << "Keys lost across relayouts";
+    ASSERT(avlTree.poolStats().liveNodes == avlTree.getsize()) << "Nodes leaked across relayouts";
+
+    // With relayout enabled the bulk build lands in the same layout
+    avlTree.buildFromUnsorted(shapeBefore.begin(), shapeBefore.end());
+    ASSERT(avlTree.getsize() == 0 || (avlTree.poolStats().slabs == 1 && nodesWithin(avlTree.root, avlTree.root, avlTree.root + avlTree.getsize()))) << "Bulk build did not pack the nodes";
+    ASSERT(verifiedHeight(avlTree.root) != -1) << "Bulk build broke heights or sizes";
+}
+
+TEST(BucketAVLTree, MatchesSet)
+{
+    const BucketSearchKernel kernels[] = {BucketSearchKernel::Scalar, BucketSearchKernel::SSE2, BucketSearchKernel::AVX2};
+    for (std::size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        BasicBucketAVLTree<16> bucketTree;
+        if (!bucketTree.setSearchKernel(kernels[k]))
+        {
+            continue;
+        }
+        std::set<int> expected;
+        const int numOperations = DeepState_IntInRange(0, 2000);
+        for (int i = 0; i < numOperations; ++i)
+        {
+            int value = DeepState_IntInRange(-300, 300);
+            if (DeepState_IntInRange(0, 2) != 0)
+            {
+                bucketTree.insert(value);
+                expected.insert(value);
+            }
+            else
+            {
+                bucketTree.remove(value);
+                expected.erase(value);
+            }
+        }
+
+        std::vector<int> keys;
+        bucketTree.inorderTraversal(std::back_inserter(keys));
+        ASSERT(keys == std::vector<int>(expected.begin(), expected.end())) << "Bucket tree keys are incorrect";
+        ASSERT(bucketTree.getsize() == expected.size()) << "Bucket tree size is incorrect";
+        ASSERT(bucketTree.isBalanced()) << "Bucket tree is unbalanced";
+        ASSERT(bucketTree.minimum() == (expected.empty() ? -1 : *expected.begin())) << "Bucket tree minimum is incorrect";
+        ASSERT(bucketTree.maximum() == (expected.empty() ? -1 : *expected.rbegin())) << "Bucket tree maximum is incorrect";
+
+        for (int key = -305; key <= 305; key++)
+        {
+            ASSERT(bucketTree.contains(key) == (expected.count(key) != 0)) << "Bucket contains(" << key << ") is incorrect";
+            std::set<int>::iterator next = expected.upper_bound(key);
+            ASSERT(bucketTree.successor(key) == (next == expected.end() ? -1 : *next)) << "Bucket successor(" << key << ") is incorrect";
+            std::set<int>::iterator lower = expected.lower_bound(key);
+            ASSERT(bucketTree.predecessor(key) == (lower == expected.begin() ? -1 : *--lower)) << "Bucket predecessor(" << key << ") is incorrect";
+        }
+    }
+}
+
+TEST(AVLTree, BatchedLookups)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-1000, 1000));
+    }
+
+    // Batch sizes around the group size exercise partial groups
+    const int numProbes = DeepState_IntInRange(0, 100);
+    std::vector<int> probes(numProbes);
+    for (int i = 0; i < numProbes; i++)
+    {
+        probes[i] = DeepState_IntInRange(-1100, 1100);
+    }
+    bool found[100];
+    std::vector<int> successors(numProbes);
+    avlTree.containsBatch(probes.data(), probes.size(), found);
+    avlTree.successorBatch(probes.data(), probes.size(), successors.data());
+    for (int i = 0; i < numProbes; i++)
+    {
+        ASSERT(found[i] == avlTree.contains(probes[i])) << "containsBatch(" << probes[i] << ") is incorrect";
+        ASSERT(successors[i] == avlTree.successor(probes[i])) << "successorBatch(" << probes[i] << ") is incorrect";
+    }
+}
+
+TEST(AVLTree, BatchInsertErase)
+{
+    AVLTree avlTree;
+    std::set<int> expected;
+    const int numValues = DeepState_IntInRange(0, 200);
+    for (int i = 0; i < numValues; ++i)
+    {
+        int value = DeepState_IntInRange(-1000, 1000);
+        avlTree.insert(value);
+        expected.insert(value);
+    }
+
+    for (int round = 0; round < 4; round++)
+    {
+        // Unsorted batches with duplicates, overlapping the tree's keys
+        std::vector<int> batch(DeepState_IntInRange(0, 150));
+        for (std::size_t i = 0; i < batch.size(); i++)
+        {
+            batch[i] = DeepState_IntInRange(-1000, 1000);
+        }
+        if (DeepState_Bool())
+        {
+            std::sort(batch.begin(), batch.end());
+        }
+        if (round % 2 == 0)
+        {
+            avlTree.insertBatch(batch.begin(), batch.end());
+            expected.insert(batch.begin(), batch.end());
+        }
+        else
+        {
+            avlTree.eraseBatch(batch.begin(), batch.end());
+            for (std::size_t i = 0; i < batch.size(); i++)
+            {
+                expected.erase(batch[i]);
+            }
+        }
+        ASSERT(verifiedHeight(avlTree.root) != -1) << "Batch left the tree unbalanced";
+        ASSERT(avlTree.getsize() == expected.size()) << "Size after batch is incorrect";
+        ASSERT(std::equal(avlTree.begin(), avlTree.end(), expected.begin())) << "Keys after batch are incorrect";
+        ASSERT(avlTree.poolStats().liveNodes == avlTree.getsize()) << "Batch leaked nodes";
+    }
+}
+
+TEST(AVLTree, Serialization)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-100000, 100000));
+    }
+
+    std::stringstream snapshot;
+    avlTree.serialize(snapshot);
+    const std::string bytes = snapshot.str();
+
+    AVLTree reloaded;
+    reloaded.insert(7);
+    reloaded.deserialize_in(snapshot);
+    ASSERT(verifiedHeight(reloaded.root) != -1) << "Reloaded tree is unbalanced";
+    ASSERT(reloaded.getsize() == avlTree.getsize()) << "Reloaded size is incorrect";
+    ASSERT(std::equal(reloaded.begin(), reloaded.end(), avlTree.begin())) << "Reloaded keys are incorrect";
+
+    // A flipped bit or a short read must be rejected without touching the tree
+    std::string damaged = bytes;
+    if (DeepState_Bool())
+    {
+        std::size_t at = DeepState_UIntInRange(0, damaged.size() - 1);
+        damaged[at] = static_cast<char>(damaged[at] ^ (1 << DeepState_IntInRange(0, 7)));
+    }
+    else
+    {
+        damaged.resize(DeepState_UIntInRange(0, damaged.size() - 1));
+    }
+    std::stringstream corrupt(damaged);
+    bool rejected = false;
+    try
+    {
+        reloaded.deserialize_in(corrupt);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    ASSERT(rejected) << "Damaged snapshot was accepted";
+    ASSERT(reloaded.getsize() == avlTree.getsize()) << "Failed reload changed the tree";
+    ASSERT(std::equal(reloaded.begin(), reloaded.end(), avlTree.begin())) << "Failed reload changed the keys";
+
+    // A header claiming an enormous tree is rejected as corrupt rather than
+    // failing in an allocation
+    std::string huge = bytes.substr(0, AVLTree::snapshotHeaderSize - 16);
+    std::uint64_t claimed = std::uint64_t(1) << DeepState_IntInRange(30, 63);
+    avl_detail::putFixed(huge, claimed, 8);
+    avl_detail::putFixed(huge, claimed, 8);
+    huge.resize(AVLTree::snapshotHeaderSize + 100, '\x01');
+    std::stringstream oversized(huge);
+    rejected = false;
+    try
+    {
+        reloaded.deserialize_in(oversized);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    ASSERT(rejected) << "Oversized snapshot header was accepted";
+    ASSERT(reloaded.getsize() == avlTree.getsize()) << "Oversized reload changed the tree";
+}
+
+TEST(MappedAVLView, MatchesAVLTree)
+{
+    AVLTree avlTree;
+    const int numValues = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numValues; ++i)
+    {
+        avlTree.insert(DeepState_IntInRange(-1000, 1000));
+    }
+
+    char path[] = "/tmp/avlimageXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0) << "Cannot create a temporary image file";
+    close(fd);
+    {
+        std::ofstream out(path, std::ios::binary);
+        MappedAVLView::writeImage(out, avlTree);
+    }
+
+    {
+        MappedAVLView view(path);
+        ASSERT(view.size() == avlTree.getsize()) << "Mapped size is incorrect";
+        ASSERT((reinterpret_cast<std::uintptr_t>(view.keys) - sizeof(int)) % 64 == 0) << "Mapped keys are not line-offset";
+        ASSERT(view.minimum() == avlTree.minimum() && view.maximum() == avlTree.maximum()) << "Mapped min/max is incorrect";
+        for (int i = 0; i < 50; i++)
+        {
+            int key = DeepState_IntInRange(-1100, 1100);
+            ASSERT(view.contains(key) == avlTree.contains(key)) << "Mapped contains(" << key << ") is incorrect";
+            ASSERT(view.successor(key) == avlTree.successor(key)) << "Mapped successor(" << key << ") is incorrect";
+            ASSERT(view.predecessor(key) == avlTree.predecessor(key)) << "Mapped predecessor(" << key << ") is incorrect";
+
+            int k2 = DeepState_IntInRange(-1100, 1100);
+            std::vector<int> viewRange;
+            std::vector<int> treeRange;
+            view.rangeSearch(key, k2, std::back_inserter(viewRange));
+            avlTree.rangeSearch(key, k2, std::back_inserter(treeRange));
+            ASSERT(viewRange == treeRange) << "Mapped rangeSearch is incorrect";
+        }
+
+        // A moved-from view gives up the mapping
+        MappedAVLView moved(std::move(view));
+        ASSERT(view.empty() && moved.size() == avlTree.getsize()) << "Moving a view is incorrect";
+    }
+
+    // Images of another key type, truncated images and missing files are refused
+    {
+        std::ofstream out(path, std::ios::binary);
+        BasicMappedAVLView<long long>::writeImage(out, BasicFrozenSet<long long>());
+    }
+    bool rejected = false;
+    try
+    {
+        MappedAVLView view(path);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    ASSERT(rejected) << "Image with the wrong key size was accepted";
+    std::remove(path);
+
+    rejected = false;
+    try
+    {
+        MappedAVLView view(path);
+    }
+    catch (const std::runtime_error &)
+    {
+        rejected = true;
+    }
+    ASSERT(rejected) << "Missing image was accepted";
+}
+
+TEST(DurableAVLTree, RecoversAfterRestart)
+{
+    char directory[] = "/tmp/avlwalXXXXXX";
+    ASSERT(mkdtemp(directory) != nullptr) << "Cannot create a temporary directory";
+    const std::string snapshotPath = std::string(directory) + "/tree.snapshot";
+    const std::string logPath = std::string(directory) + "/tree.log";
+    std::set<int> expected;
+
+    for (int session = 0; session < 3; session++)
+    {
+        DurableAVLTree durable(snapshotPath, logPath, std::chrono::microseconds(100), 64);
+        ASSERT(durable.getsize() == expected.size()) << "Recovered size is incorrect";
+        ASSERT(std::equal(durable.contents().begin(), durable.contents().end(), expected.begin())) << "Recovered keys are incorrect";
+
+        const int numOps = DeepState_IntInRange(0, 200);
+        std::uint64_t lsn = 0;
+        for (int i = 0; i < numOps; i++)
+        {
+            int key = DeepState_IntInRange(-300, 300);
+            switch (DeepState_IntInRange(0, 3))
+            {
+            case 0:
+            case 1:
+                lsn = durable.insert(key);
+                expected.insert(key);
+                break;
+            case 2:
+                lsn = durable.remove(key);
+                expected.erase(key);
+                break;
+            default:
+            {
+                int newKey = DeepState_IntInRange(-300, 300);
+                lsn = durable.updateKey(key, newKey);
+                if (expected.erase(key) != 0)
+                {
+                    expected.insert(newKey);
+                }
+                break;
+            }
+            }
+            if (i == numOps / 2 && DeepState_Bool())
+            {
+                durable.checkpoint();
+            }
+        }
+        if (lsn != 0)
+        {
+            durable.waitDurable(lsn);
+        }
+        ASSERT(std::equal(durable.contents().begin(), durable.contents().end(), expected.begin())) << "Logged tree diverged";
+    }
+
+    // A torn record at the end of the log, as left by a crash mid-write, is dropped
+    FILE *log = std::fopen(logPath.c_str(), "ab");
+    std::fwrite("torn", 1, 4, log);
+    std::fclose(log);
+    {
+        DurableAVLTree durable(snapshotPath, logPath);
+        ASSERT(durable.getsize() == expected.size()) << "Torn tail changed the recovered size";
+        ASSERT(std::equal(durable.contents().begin(), durable.contents().end(), expected.begin())) << "Torn tail changed the recovered keys";
+        durable.insert(1000);
+    }
+    {
+        DurableAVLTree durable(snapshotPath, logPath);
+        ASSERT(durable.contents().contains(1000)) << "Record logged after a torn tail was lost";
+    }
+
+    std::remove(snapshotPath.c_str());
+    std::remove(logPath.c_str());
+    rmdir(directory);
+}
+
+static int verifiedHeight(const PersistentAVLTree::Node *node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+    int left = verifiedHeight(node->left);
+    int right = verifiedHeight(node->right);
+    if (left == -1 || right == -1 || std::abs(left - right) > 1 || node->height != 1 + std::max(left, right))
+    {
+        return -1;
+    }
+    return node->height;
+}
+
+TEST(PersistentAVLTree, SnapshotsAreStable)
+{
+    PersistentAVLTree tree;
+    std::set<int> expected;
+    std::vector<PersistentAVLTree::Snapshot> snapshots;
+    std::vector<std::vector<int> > snapshotKeys;
+
+    const int numOps = DeepState_IntInRange(0, 400);
+    for (int i = 0; i < numOps; i++)
+    {
+        int key = DeepState_IntInRange(-200, 200);
+        if (DeepState_IntInRange(0, 2) != 0)
+        {
+            tree.insert(key);
+            expected.insert(key);
+        }
+        else
+        {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        if (DeepState_IntInRange(0, 40) == 0)
+        {
+            snapshots.push_back(tree.snapshot());
+            snapshotKeys.push_back(std::vector<int>(expected.begin(), expected.end()));
+        }
+    }
+
+    ASSERT(verifiedHeight(tree.root) != -1) << "Persistent tree is unbalanced";
+    ASSERT(tree.getsize() == expected.size()) << "Persistent size is incorrect";
+    for (int i = 0; i < 30; i++)
+    {
+        int key = DeepState_IntInRange(-250, 250);
+        std::set<int>::iterator above = expected.upper_bound(key);
+        std::set<int>::iterator atOrAbove = expected.lower_bound(key);
+        ASSERT(tree.contains(key) == (expected.count(key) != 0)) << "Persistent contains(" << key << ") is incorrect";
+        ASSERT(tree.successor(key) == (above != expected.end() ? *above : -1)) << "Persistent successor(" << key << ") is incorrect";
+        ASSERT(tree.predecessor(key) == (atOrAbove != expected.begin() ? *--atOrAbove : -1)) << "Persistent predecessor(" << key << ") is incorrect";
+    }
+
+    // Every snapshot still shows the keys it was taken with, read from another thread
+    bool intact = true;
+    std::thread reader([&]() {
+        for (std::size_t i = 0; i < snapshots.size(); i++)
+        {
+            std::vector<int> keys;
+            snapshots[i].rangeSearch(-1000, 1000, std::back_inserter(keys));
+            intact = intact && keys == snapshotKeys[i] && snapshots[i].size() == keys.size();
+        }
+    });
+    for (int i = 0; i < 100; i++)
+    {
+        tree.insert(DeepState_IntInRange(-200, 200));
+    }
+    reader.join();
+    ASSERT(intact) << "A snapshot changed after it was taken";
+
+    // Dropping the tree leaves the snapshots usable
+    tree.clear();
+    PersistentAVLTree::Snapshot copy = snapshots.empty() ? tree.snapshot() : snapshots.back();
+    snapshots.clear();
+    ASSERT(copy.size() == (snapshotKeys.empty() ? 0 : snapshotKeys.back().size())) << "Snapshot copy lost its keys";
+}
+
+static int verifiedHeight(const ConcurrentAVLTree::Node *node)
+{
+    if (node == nullptr)
+    {
+        return 0;
+    }
+    int left = verifiedHeight(node->left.load());
+    int right = verifiedHeight(node->right.load());
+    if (left == -1 || right == -1 || std::abs(left - right) > 1 || node->height.load() != 1 + std::max(left, right))
+    {
+        return -1;
+    }
+    return node->height.load();
+}
+
+TEST(ConcurrentAVLTree, MatchesSet)
+{
+    ConcurrentAVLTree tree;
+    std::set<int> expected;
+
+    const int numOps = DeepState_IntInRange(0, 400);
+    for (int i = 0; i < numOps; i++)
+    {
+        int key = DeepState_IntInRange(-200, 200);
+        if (DeepState_IntInRange(0, 2) != 0)
+        {
+            ASSERT(tree.insert(key) == expected.insert(key).second) << "Concurrent insert(" << key << ") result is incorrect";
+        }
+        else
+        {
+            ASSERT(tree.remove(key) == (expected.erase(key) != 0)) << "Concurrent remove(" << key << ") result is incorrect";
+        }
+    }
+
+    ASSERT(verifiedHeight(tree.rootHolder->right.load()) != -1) << "Concurrent tree is unbalanced";
+    ASSERT(tree.getsize() == expected.size()) << "Concurrent size is incorrect";
+    ASSERT(tree.minimum() == (expected.empty() ? -1 : *expected.begin())) << "Concurrent minimum is incorrect";
+    ASSERT(tree.maximum() == (expected.empty() ? -1 : *expected.rbegin())) << "Concurrent maximum is incorrect";
+    for (int i = 0; i < 30; i++)
+    {
+        int key = DeepState_IntInRange(-250, 250);
+        std::set<int>::iterator above = expected.upper_bound(key);
+        std::set<int>::iterator atOrAbove = expected.lower_bound(key);
+        ASSERT(tree.contains(key) == (expected.count(key) != 0)) << "Concurrent contains(" << key << ") is incorrect";
+        ASSERT(tree.successor(key) == (above != expected.end() ? *above : -1)) << "Concurrent successor(" << key << ") is incorrect";
+        ASSERT(tree.predecessor(key) == (atOrAbove != expected.begin() ? *--atOrAbove : -1)) << "Concurrent predecessor(" << key << ") is incorrect";
+    }
+
+    // Writers churn the odd keys while readers check that the even keys,
+    // which nobody touches, stay visible through the rotations
+    ConcurrentAVLTree shared;
+    for (int key = 0; key < 2000; key += 2)
+    {
+        shared.insert(key);
+    }
+    bool stable = true;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < 2; w++)
+    {
+        threads.push_back(std::thread([&shared, w]() {
+            for (int i = 0; i < 20000; i++)
+            {
+                int key = 4 * ((i * 7919) % 500) + 2 * w + 1;
+                if ((i / 500) % 2 == 0)
+                {
+                    shared.insert(key);
+                }
+                else
+                {
+                    shared.remove(key);
+                }
+            }
+        }));
+    }
+    std::thread reader([&shared, &stable]() {
+        for (int i = 0; i < 20000; i++)
+        {
+            int key = 2 * (i % 1000);
+            int next = shared.successor(key);
+            int previous = shared.predecessor(key);
+            stable = stable && shared.contains(key) && (next == key + 1 || next == key + 2 || (key == 1998 && (next == -1 || next == 1999))) &&
+                     (key == 0 || previous == key - 1 || previous == key - 2);
+        }
+    });
+    for (std::size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    reader.join();
+    ASSERT(stable) << "A reader missed a key no writer touched";
+
+    std::size_t count = 0;
+    int previous = -1;
+    for (int key = shared.minimum(); key != -1; key = shared.successor(key))
+    {
+        ASSERT(key > previous) << "Concurrent keys are out of order";
+        previous = key;
+        count++;
+    }
+    ASSERT(count == shared.getsize()) << "Concurrent size disagrees with its keys";
+    ASSERT(verifiedHeight(shared.rootHolder->right.load()) != -1) << "Concurrent tree is unbalanced after the writers finished";
+}
+
+static std::size_t reachableNodes(const ConcurrentAVLTree::Node *node)
+{
+    return (node == nullptr) ? 0 : 1 + reachableNodes(node->left.load()) + reachableNodes(node->right.load());
+}
+
+TEST(ConcurrentAVLTree, ReclaimsUnderChurn)
+{
+    // Each thread keeps inserting and removing keys in its own window, so
+    // nodes are unlinked all the time and the tree never goes quiet
+    ConcurrentAVLTree tree;
+    const int window = 256;
+    const int opsPerThread = DeepState_IntInRange(1000, 5000);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(std::thread([&tree, t, window, opsPerThread]() {
+            for (int i = 0; i < opsPerThread; i++)
+            {
+                int key = t * 1000 + (i * 37) % window;
+                if ((i / window) % 2 == 0)
+                {
+                    tree.insert(key);
+                }
+                else
+                {
+                    tree.remove(key);
+                }
+                tree.contains(key ^ 1);
+            }
+        }));
+    }
+    for (std::size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    // Those threads are gone with nodes still retired; one more thread's
+    // churn advances the epoch and frees theirs along with its own
+    for (int i = 0; i < 8 * static_cast<int>(ConcurrentAVLTree::retireBatch); i++)
+    {
+        tree.insert(1000000 + i);
+        tree.remove(1000000 + i);
+    }
+
+    std::size_t pending = 0;
+    for (ConcurrentAVLTree::ThreadRecord *record = tree.records.load(); record != nullptr; record = record->next)
+    {
+        ASSERT(record->epoch.load() == 0) << "A thread record was left inside the tree";
+        pending += record->retired.size();
+    }
+    std::size_t reachable = reachableNodes(tree.rootHolder->right.load());
+    ASSERT(pending <= 3 * ConcurrentAVLTree::retireBatch) << pending << " unlinked nodes were never freed";
+    ASSERT(reachable + pending <= 4 * window + 3 * ConcurrentAVLTree::retireBatch) << "Live nodes grew with churn: " << reachable << " reachable, " << pending << " retired";
+}
+
+TEST(ShardedAVL, MatchesSet)
+{
+    // Small shards so that the ascending inserts below force reshards
+    ShardedAVL ranged(4, ShardMode::Range, 2.0, 8);
+    ShardedAVL hashed(4, ShardMode::Hash);
+    std::set<int> expected;
+
+    const int numOps = DeepState_IntInRange(0, 400);
+    for (int i = 0; i < numOps; i++)
+    {
+        int key = (DeepState_IntInRange(0, 3) == 0) ? i : DeepState_IntInRange(-200, 200);
+        if (DeepState_IntInRange(0, 2) != 0)
+        {
+            bool inserted = expected.insert(key).second;
+            ASSERT(ranged.insert(key) == inserted) << "Range-sharded insert(" << key << ") result is incorrect";
+            ASSERT(hashed.insert(key) == inserted) << "Hash-sharded insert(" << key << ") result is incorrect";
+        }
+        else
+        {
+            bool removed = expected.erase(key) != 0;
+            ASSERT(ranged.remove(key) == removed) << "Range-sharded remove(" << key << ") result is incorrect";
+            ASSERT(hashed.remove(key) == removed) << "Hash-sharded remove(" << key << ") result is incorrect";
+        }
+    }
+
+    ShardedAVL *sets[] = {&ranged, &hashed};
+    for (int s = 0; s < 2; s++)
+    {
+        ShardedAVL &sharded = *sets[s];
+        ASSERT(sharded.getsize() == expected.size()) << "Sharded size is incorrect";
+        ASSERT(sharded.minimum() == (expected.empty() ? -1 : *expected.begin())) << "Sharded minimum is incorrect";
+        ASSERT(sharded.maximum() == (expected.empty() ? -1 : *expected.rbegin())) << "Sharded maximum is incorrect";
+        for (int i = 0; i < 30; i++)
+        {
+            int key = DeepState_IntInRange(-250, 450);
+            std::set<int>::iterator above = expected.upper_bound(key);
+            std::set<int>::iterator atOrAbove = expected.lower_bound(key);
+            ASSERT(sharded.contains(key) == (expected.count(key) != 0)) << "Sharded contains(" << key << ") is incorrect";
+            ASSERT(sharded.successor(key) == (above != expected.end() ? *above : -1)) << "Sharded successor(" << key << ") is incorrect";
+            ASSERT(sharded.predecessor(key) == (atOrAbove != expected.begin() ? *--atOrAbove : -1)) << "Sharded predecessor(" << key << ") is incorrect";
+        }
+        int k1 = DeepState_IntInRange(-250, 450);
+        int k2 = DeepState_IntInRange(-250, 450);
+        std::vector<int> found;
+        sharded.rangeSearch(k1, k2, std::back_inserter(found));
+        std::vector<int> wanted;
+        if (k1 <= k2)
+        {
+            wanted.assign(expected.lower_bound(k1), expected.upper_bound(k2));
+        }
+        ASSERT(found == wanted) << "Sharded rangeSearch(" << k1 << ", " << k2 << ") is incorrect";
+    }
+
+    // Threads inserting disjoint ascending runs keep resharding under each other
+    ShardedAVL shared(4, ShardMode::Range, 2.0, 16);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(std::thread([&shared, t]() {
+            for (int i = 0; i < 2000; i++)
+            {
+                shared.insert(t * 100000 + i);
+                if (i % 3 == 0)
+                {
+                    shared.remove(t * 100000 + i / 2);
+                }
+            }
+        }));
+    }
+    for (std::size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    std::vector<int> keys;
+    shared.rangeSearch(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), std::back_inserter(keys));
+    ASSERT(keys.size() == shared.getsize()) << "Sharded size disagrees with its keys";
+    ASSERT(std::adjacent_find(keys.begin(), keys.end(), std::greater_equal<int>()) == keys.end()) << "Sharded keys are out of order";
+    std::size_t largest = 0;
+    for (std::size_t i = 0; i < shared.shards.size(); i++)
+    {
+        largest = std::max(largest, shared.shards[i]->tree.size);
+    }
+    ASSERT(largest < keys.size()) << "Keys were never spread over the shards";
+}
+
+static std::size_t nonEmptyShards(const ShardedAVL &sharded)
+{
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < sharded.shards.size(); i++)
+    {
+        count += (sharded.shards[i]->tree.size != 0) ? 1 : 0;
+    }
+    return count;
+}
+
+TEST(ShardedAVL, SpreadsBeforeFirstReshard)
+{
+    // Bounds start spread over the int domain, so keys drawn from all of it
+    // use most shards long before the first reshard could run
+    ShardedAVL wide(16);
+    for (int i = 0; i < 200; i++)
+    {
+        wide.insert(DeepState_Int());
+    }
+    ASSERT(!wide.sampled.load()) << "Range shards were cut before minShardKeys keys arrived";
+    ASSERT(nonEmptyShards(wide) > 8) << "Keys over the whole domain landed in " << nonEmptyShards(wide) << " of 16 shards";
+
+    // Keys bunched in a narrow band share a shard only until the first
+    // minShardKeys of them are in, and are then cut from the keys themselves
+    const std::size_t minShardKeys = 64;
+    ShardedAVL narrow(8, ShardMode::Range, 2.0, minShardKeys);
+    int base = DeepState_IntInRange(-1000000, 1000000);
+    while (narrow.getsize() < minShardKeys)
+    {
+        narrow.insert(base + DeepState_IntInRange(0, 10000));
+    }
+    ASSERT(narrow.sampled.load()) << "Range shards were not cut once minShardKeys keys arrived";
+    ASSERT(nonEmptyShards(narrow) == 8) << "Keys in a narrow band landed in " << nonEmptyShards(narrow) << " of 8 shards";
+    for (int i = 0; i < 100; i++)
+    {
+        narrow.insert(base + DeepState_IntInRange(0, 10000));
+    }
+    ASSERT(nonEmptyShards(narrow) == 8) << "Shards emptied out after the first cut";
+}
+
+TEST(SharedAVLTree, ConcurrentReaders)
+{
+    SharedAVLTree tree;
+    std::set<int> expected;
+
+    const int numOps = DeepState_IntInRange(0, 300);
+    for (int i = 0; i < numOps; i++)
+    {
+        int key = DeepState_IntInRange(-200, 200);
+        if (DeepState_IntInRange(0, 2) != 0)
+        {
+            tree.insert(key);
+            expected.insert(key);
+        }
+        else
+        {
+            tree.remove(key);
+            expected.erase(key);
+        }
+    }
+
+    ASSERT(tree.getsize() == expected.size()) << "Shared size is incorrect";
+    ASSERT(tree.minimum() == (expected.empty() ? -1 : *expected.begin())) << "Shared minimum is incorrect";
+    ASSERT(tree.maximum() == (expected.empty() ? -1 : *expected.rbegin())) << "Shared maximum is incorrect";
+    for (int i = 0; i < 30; i++)
+    {
+        int key = DeepState_IntInRange(-250, 250);
+        std::set<int>::iterator above = expected.upper_bound(key);
+        std::set<int>::iterator atOrAbove = expected.lower_bound(key);
+        ASSERT(tree.contains(key) == (expected.count(key) != 0)) << "Shared contains(" << key << ") is incorrect";
+        ASSERT(tree.successor(key) == (above != expected.end() ? *above : -1)) << "Shared successor(" << key << ") is incorrect";
+        ASSERT(tree.predecessor(key) == (atOrAbove != expected.begin() ? *--atOrAbove : -1)) << "Shared predecessor(" << key << ") is incorrect";
+    }
+
+    // Readers, each with its own buffers, see every full traversal and
+    // range as a consistent set while a writer churns keys above 1000
+    std::vector<int> stable(expected.begin(), expected.end());
+    bool consistent = true;
+    std::mutex resultLock;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++)
+    {
+        readers.push_back(std::thread([&tree, &stable, &consistent, &resultLock]() {
+            bool ok = true;
+            for (int i = 0; i < 300; i++)
+            {
+                std::vector<int> all;
+                tree.inorderTraversal(std::back_inserter(all));
+                std::vector<int> low;
+                tree.rangeSearch(-1000, 999, std::back_inserter(low));
+                ok = ok && low == stable && std::is_sorted(all.begin(), all.end()) &&
+                     std::equal(stable.begin(), stable.end(), all.begin()) &&
+                     tree.read([&stable](const SharedAVLTree::Tree &t) {
+                         return t.countRange(-1000, 999) == stable.size() && t.size >= stable.size();
+                     });
+            }
+            std::lock_guard<std::mutex> guard(resultLock);
+            consistent = consistent && ok;
+        }));
+    }
+    for (int i = 0; i < 3000; i++)
+    {
+        if (i % 2 == 0)
+        {
+            tree.insert(1000 + i);
+        }
+        else
+        {
+            tree.remove(1000 + i - 1);
+        }
+    }
+    for (std::size_t i = 0; i < readers.size(); i++)
+    {
+        readers[i].join();
+    }
+    ASSERT(consistent) << "A reader saw a torn or changed result";
+    ASSERT(tree.getsize() == stable.size()) << "Shared size is incorrect after the writer finished";
+}
+
+TEST(ReaderWriterLock, SlotsOnOwnLines)
+{
+    ReaderWriterLock lock(static_cast<unsigned>(DeepState_IntInRange(0, 33)));
+    ASSERT(sizeof(ReaderWriterLock::Slot) == 64) << "A reader slot is not one cache line";
+    for (std::size_t i = 0; i < lock.slotCount; i++)
+    {
+        ASSERT(reinterpret_cast<std::uintptr_t>(&lock.slots[i]) % 64 == 0) << "Reader slot " << i << " straddles two cache lines";
+        ASSERT(lock.slots[i].readers.load() == 0) << "Reader slot " << i << " does not start empty";
+    }
+
+    lock.lock_shared();
+    lock.lock_shared();
+    std::size_t held = 0;
+    for (std::size_t i = 0; i < lock.slotCount; i++)
+    {
+        held += static_cast<std::size_t>(lock.slots[i].readers.load());
+    }
+    ASSERT(held == 2) << "Reader slots count " << held << " readers, not 2";
+    lock.unlock_shared();
+    lock.unlock_shared();
+    lock.lock();
+    lock.unlock();
+}
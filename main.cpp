@@ -1,5 +1,6 @@
 #include "AVLTree.h"
 #include <iostream>
+#include <sstream>
 
 int main()
 {
@@ -102,17 +103,26 @@ int main()
     // std::cout << "Is AVL tree balanced after clearing: " << std::boolalpha << avlTree.isBalanced() << std::endl;
 
     // Test serialization and deserialization
-    // std::cout << "Serializing AVL tree..." << std::endl;
-    // std::stringstream serializedTree;
-    // avlTree.serialize(serializedTree);
-    // std::cout << "Serialized AVL tree: " << serializedTree.str() << std::endl;
-
-    // std::cout << "Deserializing AVL tree..." << std::endl;
-    // AVLTree deserializedTree;
-    // deserializedTree.deserialize_in(serializedTree);
-    // std::cout << "Inorder traversal of deserialized AVL tree: ";
-    // deserializedTree.inorderTraversal();
-    // std::cout << std::endl;
+    for (int value = 1; value <= 20; value++)
+    {
+        avlTree.insert(value * 5);
+    }
+    std::cout << "Serializing AVL tree..." << std::endl;
+    std::stringstream serializedTree;
+    avlTree.serialize(serializedTree);
+    std::cout << "Serialized AVL tree: " << serializedTree.str().size() << " bytes" << std::endl;
+
+    std::cout << "Deserializing AVL tree..." << std::endl;
+    AVLTree deserializedTree;
+    deserializedTree.deserialize_in(serializedTree);
+    std::cout << "Inorder traversal of deserialized AVL tree: ";
+    deserializedTree.inorderTraversal();
+    for (std::size_t i = 0; i < deserializedTree.result->size(); i++)
+    {
+        std::cout << deserializedTree.result->at(i) << " ";
+    }
+    std::cout << std::endl;
+    deserializedTree.result->clear();
 
     return 0;
 }